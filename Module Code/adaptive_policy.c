@@ -0,0 +1,364 @@
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/device.h>
+#include <linux/string.h>
+
+#include "elevator_core.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Adrianna Chang & Britta Evans");
+MODULE_DESCRIPTION("Linux device to simulate elevator system that switches algorithm with the traffic pattern");
+
+const char elevatorName[] = "adaptive";
+const char algorithmName[] = "ADAPTIVE";
+const int elevatorCapacity = 16;
+const int elevatorPolicy = NUM_POLICIES; // decisions shows the algorithms that made decisions
+
+// Traffic regimes, classified from the demand estimates
+#define UP_PEAK 0 // most passengers start at the ground floor
+#define DOWN_PEAK 1 // most passengers are going to the ground floor
+#define INTERFLOOR 2 // everything else
+#define NUM_REGIMES 3
+
+// Regime switching hysteresis
+#define REGIME_ENTER 60 // % of demand needed to enter a peak regime
+#define REGIME_EXIT 40 // % of demand below which a peak regime is left
+#define REGIME_HOLD 3 // consecutive decisions a new regime must be seen for before switching to it
+
+// Policy used in each traffic regime
+static char *up_peak_policy = "sdf";
+module_param(up_peak_policy, charp, S_IRUGO);
+MODULE_PARM_DESC(up_peak_policy, "Algorithm used during up-peak traffic (fcfs, sdf or round_robin)");
+
+static char *down_peak_policy = "round_robin";
+module_param(down_peak_policy, charp, S_IRUGO);
+MODULE_PARM_DESC(down_peak_policy, "Algorithm used during down-peak traffic (fcfs, sdf or round_robin)");
+
+static char *interfloor_policy = "sdf";
+module_param(interfloor_policy, charp, S_IRUGO);
+MODULE_PARM_DESC(interfloor_policy, "Algorithm used during inter-floor traffic (fcfs, sdf or round_robin)");
+
+static const char *regimeNames[NUM_REGIMES] = { "up-peak", "down-peak", "interfloor" };
+
+// Meta-scheduler state
+int regimePolicy[NUM_REGIMES]; // policy for each regime, resolved from the module parameters at init
+int currentRegime = INTERFLOOR;
+int pendingRegime = INTERFLOOR; // regime seen in the last decisions that differs from currentRegime
+int pendingCount = 0; // number of consecutive decisions pendingRegime has been seen for
+int regimeSwitches = 0;
+int policyDecisions[NUM_POLICIES] = {0}; // number of decisions made by each policy
+int elevatorDirection = 1; // round robin sweep direction, 1 = up, -1 = down
+
+// meta-scheduler prototypes
+int policyFromName(const char*);
+int classifyTraffic(void);
+int choosePolicy(void);
+int fcfsTarget(void);
+int roundRobinTarget(void);
+int policyTarget(int);
+void fcfsStep(void);
+void sdfStep(void);
+void roundRobinStep(void);
+
+static ssize_t regime_show(struct device *, struct device_attribute *, char *);
+static DEVICE_ATTR_RO(regime);
+
+/* Initialization function
+ */
+static int __init adaptive_init(void) {
+  int error;
+
+  regimePolicy[UP_PEAK] = policyFromName(up_peak_policy);
+  regimePolicy[DOWN_PEAK] = policyFromName(down_peak_policy);
+  regimePolicy[INTERFLOOR] = policyFromName(interfloor_policy);
+  if (regimePolicy[UP_PEAK] < 0 || regimePolicy[DOWN_PEAK] < 0 || regimePolicy[INTERFLOOR] < 0) {
+    printk(KERN_ALERT "adaptive: unknown policy, use fcfs, sdf or round_robin\n");
+    return -EINVAL;
+  }
+
+  error = elevator_init();
+  if (error) {
+    return error;
+  }
+
+  // expose the current regime as /sys/class/myclass/adaptive/regime
+  if (device_create_file(driverDevice, &dev_attr_regime)) {
+    elevator_exit();
+    printk(KERN_ALERT "adaptive: failed to create sysfs attributes\n");
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+static void __exit adaptive_exit(void) {
+  device_remove_file(driverDevice, &dev_attr_regime);
+  elevator_exit();
+}
+
+/* Called when /sys/class/myclass/adaptive/regime is read.
+* Prints the traffic regime, the policy in use, how often the regime changed and how many decisions each policy made.
+*/
+static ssize_t regime_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  int i;
+  ssize_t count = 0;
+
+  count += scnprintf(buf + count, PAGE_SIZE - count, "regime: %s\npolicy: %s\nswitches: %d\n",
+                     regimeNames[currentRegime], policyNames[regimePolicy[currentRegime]], regimeSwitches);
+  for (i=0; i<NUM_POLICIES; i++) {
+    count += scnprintf(buf + count, PAGE_SIZE - count, "%s decisions: %d\n", policyNames[i], policyDecisions[i]);
+  }
+
+  return count;
+}
+
+int policyFromName(const char *name) {
+  int i;
+
+  for (i=0; i<NUM_POLICIES; i++) {
+    if (strcmp(name, policyNames[i]) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Classify recent traffic from the demand estimates: the share of arrivals that start at the ground floor
+// (up-peak) against the share that end there (down-peak). A peak regime is entered at REGIME_ENTER percent
+// but only left once its share falls below REGIME_EXIT percent.
+int classifyTraffic() {
+  int i;
+  unsigned long total_demand = 0, to_ground_demand = 0;
+  unsigned long up_share, down_share;
+
+  for (i=0; i<NUM_FLOORS; i++) {
+    total_demand += floorDemand(i);
+    to_ground_demand += pairDemand(i, 0);
+  }
+
+  if (total_demand == 0) {
+    return currentRegime;
+  }
+
+  up_share = floorDemand(0) * 100 / total_demand;
+  down_share = to_ground_demand * 100 / total_demand;
+
+  if (currentRegime == UP_PEAK && up_share >= REGIME_EXIT) {
+    return UP_PEAK;
+  }
+  if (currentRegime == DOWN_PEAK && down_share >= REGIME_EXIT) {
+    return DOWN_PEAK;
+  }
+  if (up_share >= REGIME_ENTER && up_share >= down_share) {
+    return UP_PEAK;
+  }
+  if (down_share >= REGIME_ENTER) {
+    return DOWN_PEAK;
+  }
+  return INTERFLOOR;
+}
+
+// Pick the policy for the next decision. A new regime only takes over once it has been
+// classified for REGIME_HOLD decisions in a row, so noisy traffic doesn't flip policies every stop.
+int choosePolicy() {
+  int candidate_regime = classifyTraffic();
+
+  if (candidate_regime == currentRegime) {
+    pendingCount = 0;
+  }
+  else {
+    if (candidate_regime != pendingRegime) {
+      pendingRegime = candidate_regime;
+      pendingCount = 0;
+    }
+    pendingCount++;
+
+    if (pendingCount >= REGIME_HOLD) {
+      printk(KERN_INFO "Traffic regime %s -> %s, switching to %s", regimeNames[currentRegime],
+             regimeNames[candidate_regime], policyNames[regimePolicy[candidate_regime]]);
+      currentRegime = candidate_regime;
+      pendingCount = 0;
+      regimeSwitches++;
+    }
+  }
+
+  policyDecisions[regimePolicy[currentRegime]]++;
+  return regimePolicy[currentRegime];
+}
+
+// First come first serve: drop off the passenger in the car with the lowest id,
+// or if the car is empty, go to the floor of the waiting passenger with the lowest id
+void fcfsStep() {
+  int next_destination;
+  decisionSample sample;
+
+  startDecision(&sample);
+  next_destination = fcfsTarget();
+  endDecision(&sample, &decisionProfiles[FCFS]);
+
+  if (next_destination >= 0) {
+    moveElevatorTo(next_destination);
+    if (elevatorCar.passengerArray[elevatorCar.current_floor->id] != NULL) {
+      dropOff();
+    }
+  }
+}
+
+// Shortest distance first: if the car is empty, go to the closest floor with a waiting passenger and pick up,
+// then go to the closest drop off floor. Ties between floors the same distance away go to the lower id.
+void sdfStep() {
+  int target;
+  decisionSample sample;
+
+  if (elevatorCar.passengerCount == 0) {
+    startDecision(&sample);
+    target = closestFloor(&waitingFloors);
+    endDecision(&sample, &decisionProfiles[SDF]);
+    if (target >= 0) {
+      moveElevatorTo(target);
+    }
+    if (elevatorCar.current_floor->startQueue != NULL) {
+      pickUp();
+    }
+  }
+
+  startDecision(&sample);
+  target = closestFloor(&ridingFloors);
+  endDecision(&sample, &decisionProfiles[SDF]);
+  if (target >= 0) {
+    moveElevatorTo(target);
+  }
+
+  if (elevatorCar.passengerArray[elevatorCar.current_floor->id] != NULL) {
+    dropOff();
+  }
+}
+
+// Round robin: sweep up and down the shaft, stopping wherever someone is waiting or getting off
+void roundRobinStep() {
+  int next_floor;
+  decisionSample sample;
+
+  startDecision(&sample);
+  next_floor = roundRobinTarget();
+  endDecision(&sample, &decisionProfiles[ROUND_ROBIN]);
+
+  moveElevatorTo(next_floor);
+
+  if (elevatorCar.passengerArray[elevatorCar.current_floor->id] != NULL) {
+    dropOff();
+  }
+}
+
+// First come first serve target, see fcfsStep
+int fcfsTarget() {
+  int next_destination;
+
+  next_destination = cachedLowest(&ridingFloors);
+  if (next_destination >= 0) {
+    return next_destination;
+  }
+
+  spin_lock(&queueLock);
+  next_destination = cachedLowest(&waitingFloors);
+  spin_unlock(&queueLock);
+
+  return next_destination;
+}
+
+// Round robin target: turn around at the ends of the shaft, then the next floor in the sweep direction that needs a stop
+int roundRobinTarget() {
+  if (elevatorCar.current_floor->id == 0) {
+    elevatorDirection = 1;
+  }
+  else if (elevatorCar.current_floor->id == NUM_FLOORS - 1) {
+    elevatorDirection = -1;
+  }
+
+  return nextStop(elevatorDirection);
+}
+
+// Target of the next move according to policy
+int policyTarget(int policy) {
+  switch (policy) {
+    case FCFS:
+      return fcfsTarget();
+    case SDF:
+      if (elevatorCar.passengerCount == 0) {
+        return closestFloor(&waitingFloors);
+      }
+      return closestFloor(&ridingFloors);
+    case ROUND_ROBIN:
+      return roundRobinTarget();
+  }
+
+  return -1;
+}
+
+// Target of the next move for the timer mode state machine, chosen by the algorithm of the current traffic regime
+int nextTarget() {
+  int target, policy;
+  decisionSample sample;
+
+  // Let the traffic regime decide which algorithm makes this decision
+  policy = choosePolicy();
+  startDecision(&sample);
+  target = policyTarget(policy);
+  endDecision(&sample, &decisionProfiles[policy]);
+
+  return target;
+}
+
+// Decisions per algorithm and regime switches, logged with the results of the run
+void printPolicyResults() {
+  int i;
+
+  for (i=0; i<NUM_POLICIES; i++) {
+    printk(KERN_INFO "%s decisions: %d", policyNames[i], policyDecisions[i]);
+  }
+  printk(KERN_INFO "Regime switches: %d", regimeSwitches);
+}
+
+int thread_fn(void * v) {
+  unsigned long start_sec, start_usec, end_sec, end_usec;
+
+  if (!startElevator(&start_sec, &start_usec)) {
+    return 0;
+  }
+
+  while(existsPassengerNode() > 0 || waitForPassengers(&end_sec, &end_usec) > 0
+         || !finishElevator()) {
+    if(kthread_should_stop()) {
+      do_exit(0);
+    }
+    // Algorithm
+    // Check for pick up (a full car goes on to its drop offs instead)
+    if (shaftArray[elevatorCar.current_floor->id].startQueue != NULL && !elevatorFull()) {
+      pickUp();
+    }
+
+    // Let the traffic regime decide which algorithm makes this decision
+    switch (choosePolicy()) {
+      case FCFS:
+        fcfsStep();
+        break;
+      case SDF:
+        sdfStep();
+        break;
+      case ROUND_ROBIN:
+        roundRobinStep();
+        break;
+    }
+  }
+
+  printResults(start_sec, start_usec, end_sec, end_usec);
+
+  return 0;
+}
+
+module_init(adaptive_init);
+module_exit(adaptive_exit);
@@ -0,0 +1,2182 @@
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/device.h>
+#include <linux/spinlock.h>
+#include <linux/jiffies.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/atomic.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
+#include <linux/seqlock.h>
+#include <linux/relay.h>
+#include <linux/debugfs.h>
+#include <linux/perf_event.h>
+#include <linux/math64.h>
+#include <linux/kref.h>
+#include <linux/random.h>
+#include <linux/bitmap.h>
+#include <linux/string.h>
+#include <linux/version.h>
+
+#include "elevator_core.h"
+
+// kref_read came with 4.11, the modules were developed under 4.4
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4, 11, 0)
+#define kref_read(kref) atomic_read(&(kref)->refcount)
+#endif
+
+#define  CLASS_NAME  "myclass"
+
+static struct task_struct *elevator_thread;
+
+// Longest request dev_write accepts, "origin,destination"
+#define REQUEST_LENGTH 32
+#define MAX_GROUP 1000 // riders one request can add
+
+// What a floor index cache holds: the next floor with work down (-1) or up (1), the closest one or the lowest id
+#define QUERY_NONE -2
+#define QUERY_CLOSEST 0
+#define QUERY_LOWEST 2
+#define CACHE_MISS -2
+
+// Kinematic motion macros (distances in mm, times in ms)
+#define FLOOR_HEIGHT 3000 // mm between two adjacent floors
+#define MAX_SPEED 2500 // mm/s
+#define ACCELERATION 1500 // mm/s^2, used when leaving a floor
+#define DECELERATION 1500 // mm/s^2, used when stopping at the target floor
+
+// Demand estimation macros
+// Arrival rates are exponentially weighted moving averages in arrivals per minute, stored as fixed point
+// numbers with DEMAND_SHIFT fractional bits. Every DEMAND_PERIOD ms each rate decays by 1/32,
+// so the estimates mostly reflect the last half minute or so of traffic.
+#define DEMAND_SHIFT 10
+#define DEMAND_PERIOD 1000 // ms
+#define DEMAND_INCREMENT ((60 << DEMAND_SHIFT) / 32) // a steady stream of arrivals converges to its per minute rate
+
+// Sampler macros
+// Each sample is one line "<ms since load> <car floor> <car load> <waiting on floor 0> ... <waiting on last floor>"
+#define SAMPLE_LINE_LENGTH (32 + 12 * NUM_FLOORS)
+#define SAMPLE_SUBBUF_SIZE 16384 // bytes per relay sub-buffer
+#define SAMPLE_SUBBUFS 8 // samples are dropped once all sub-buffers are full and unread
+
+// Decision profiler macros
+#define PROFILE_MIN_NS 64 // upper bound of the first histogram bucket, each further bucket doubles it
+
+// Arrival generator macros
+#define NUM_MIXES 4
+#define MIX_TEST 0 // test_code.c: half between upper floors, a quarter up from the ground floor, a quarter down to it
+#define MIX_UNIFORM 1 // any floor to any other floor
+#define MIX_UP_PEAK 2 // PEAK_SHARE percent up from the ground floor, the rest down to it or between upper floors
+#define MIX_DOWN_PEAK 3 // the up-peak trips reversed
+#define PEAK_SHARE 80
+#define LN2_FIXED 45426 // ln(2) in 16.16 fixed point
+
+/* Elevator data structures */
+typedef struct elevatorStats {
+  int queued; // passengers waiting on a floor
+  int riding;
+  int current_floor;
+  unsigned long delivered;
+  unsigned long floorsTraveled;
+  unsigned long stops; // pick ups and drop offs, 1 second each
+  int floorDepth[NUM_FLOORS]; // passengers waiting on each floor
+  int leg_from; // floor the last move started from
+  ktime_t leg_start, leg_end; // when the car leaves leg_from and when it reaches current_floor
+} elevatorStats;
+
+typedef struct demandRate {
+  unsigned long rate; // arrivals per minute << DEMAND_SHIFT
+  unsigned long stamp; // jiffies when rate was last decayed
+} demandRate;
+
+/* Elevator global variables */
+int static nextId = 1;
+
+floorQueue shaftArray[NUM_FLOORS];
+elevator elevatorCar;
+
+int queueCount = 0;
+int firstOrigin = -1; // To know when the first system call happens and the elevator needs to start moving
+
+// Estimated arrival rates per origin floor and per origin -> destination pair, protected by demandLock
+demandRate floorDemandArray[NUM_FLOORS];
+demandRate pairDemandArray[NUM_FLOORS][NUM_FLOORS];
+static DEFINE_SPINLOCK(demandLock);
+
+DEFINE_SPINLOCK(queueLock);
+
+floorIndex waitingFloors;
+floorIndex ridingFloors;
+
+// demandDecay[k] = 65536 * (31/32)^(2^k), so any number of elapsed periods is applied in a few multiplications
+static const unsigned int demandDecay[] = { 63488, 61504, 57720, 50836, 39434, 23728, 8591, 1126, 19 };
+
+// Idle parking parameters
+static int park_floor = -1;
+module_param(park_floor, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(park_floor, "Floor the idle elevator parks at (-1 = floor with the highest recent arrival rate)");
+
+static int idle_timeout = 30;
+module_param(idle_timeout, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(idle_timeout, "Seconds a parked elevator waits for new passengers before finishing");
+
+// Backpressure: at most max_queue_depth passengers are waiting or riding at once, writers past that wait on writeQueue
+static int max_queue_depth = 64;
+module_param(max_queue_depth, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(max_queue_depth, "Passengers waiting or riding before writes block or fail with EAGAIN (0 = unlimited)");
+
+static atomic_t passengersInSystem = ATOMIC_INIT(0); // slots reserved by dev_write and released in dropOff
+static atomic_t rejectedCount = ATOMIC_INIT(0); // requests with invalid floors
+static atomic_t throttledCount = ATOMIC_INIT(0); // writes that found the queue full
+static atomic_t elevatorFinished = ATOMIC_INIT(0); // set under queueLock once the elevator has stopped for good
+static DECLARE_WAIT_QUEUE_HEAD(writeQueue);
+static DECLARE_WAIT_QUEUE_HEAD(deliveryQueue); // readers waiting for one of their passengers to be dropped off
+
+// Statistics the elevator publishes after every move, pick up and drop off. Only the elevator writes them,
+// and readers retry on statsSeq instead of taking a lock, so polling them never holds up the car.
+static elevatorStats statsSnapshot;
+static seqcount_t statsSeq = SEQCNT_ZERO(statsSeq);
+static unsigned long deliveredCount = 0, floorsTraveledCount = 0, stopCount = 0; // updated by the elevator only
+static int legFrom = 0; // last move of the car, published for takeSample
+static ktime_t legStart, legEnd;
+
+// Time series sampler, written to the relay channel /sys/kernel/debug/<module_name>/samples0
+static int sample_interval = 0;
+module_param(sample_interval, int, S_IRUGO);
+MODULE_PARM_DESC(sample_interval, "ms between samples of the floor queues, car load and car position (0 = off)");
+
+static atomic_t floorDepthCount[NUM_FLOORS]; // passengers waiting on each floor, added by dev_write, removed on boarding
+static struct dentry *sampleDir = NULL;
+static struct rchan *sampleChannel = NULL;
+static struct delayed_work sampleWork;
+static ktime_t sampleStart;
+static long sampleCount = 0;
+
+// Arrival generator: a kernel thread that adds synthetic passengers straight to the floor queues, without the device
+static int generator_rate = 0;
+module_param(generator_rate, int, S_IRUGO);
+MODULE_PARM_DESC(generator_rate, "Passengers per minute the arrival generator adds (0 = off)");
+
+static char *generator_mix = "test";
+module_param(generator_mix, charp, S_IRUGO);
+MODULE_PARM_DESC(generator_mix, "Trips the generator makes: test (as test_code.c), uniform, up_peak or down_peak");
+
+static bool generator_poisson = true;
+module_param(generator_poisson, bool, S_IRUGO);
+MODULE_PARM_DESC(generator_poisson, "Poisson arrivals (default), or exactly 1/generator_rate minutes apart if 0");
+
+static ulong generator_seed = 1;
+module_param(generator_seed, ulong, S_IRUGO);
+MODULE_PARM_DESC(generator_seed, "Seed of the generator, the same seed makes the same passengers");
+
+static int generator_count = 0;
+module_param(generator_count, int, S_IRUGO);
+MODULE_PARM_DESC(generator_count, "Passengers the generator adds before it stops (0 = until the module is removed)");
+
+static const char *mixNames[NUM_MIXES] = { "test", "uniform", "up_peak", "down_peak" };
+static int generatorMix = MIX_TEST;
+static struct task_struct *generator_thread = NULL;
+static struct rnd_state generatorState; // only used by the generator thread
+static atomic_t generatedCount = ATOMIC_INIT(0);
+
+// Decision profiler: time spent choosing where the car goes next, excluding the moves and stops themselves.
+// Only the elevator writes the profiles; decisions_show retries on profileSeq like stats_show.
+decisionProfile decisionProfiles[NUM_POLICIES];
+const char *policyNames[NUM_POLICIES] = { "fcfs", "sdf", "round_robin" };
+static seqcount_t profileSeq = SEQCNT_ZERO(profileSeq);
+static unsigned long indexSearches; // floor index searches the elevator made, cached answers aside
+
+static bool profile_counters = false;
+module_param(profile_counters, bool, S_IRUGO);
+MODULE_PARM_DESC(profile_counters, "Also count instructions, cache and branch misses per decision (thread mode only)");
+
+static struct perf_event *profileEvents[PROFILE_COUNTERS];
+static const u64 profileEventConfigs[PROFILE_COUNTERS] = {
+  PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static const char *profileEventNames[PROFILE_COUNTERS] = { "instructions", "cache_misses", "branch_misses" };
+
+// Execution mode: a kernel thread that sleeps through every action (default), or a state machine driven by an hrtimer
+static bool timer_mode = false;
+module_param(timer_mode, bool, S_IRUGO);
+MODULE_PARM_DESC(timer_mode, "Drive the elevator with high resolution timers instead of a sleeping kernel thread");
+
+// Timer mode states
+#define STATE_WAITING 0 // no request yet
+#define STATE_RUNNING 1 // moving, picking up or dropping off
+#define STATE_PARKED 2 // queue drained, waiting up to idle_timeout seconds for new passengers
+#define STATE_DONE 3
+
+static struct hrtimer elevatorTimer;
+static struct work_struct elevatorWork;
+static ktime_t elevatorDeadline; // when the current action ends
+static int elevatorState = STATE_WAITING;
+static unsigned int pendingDelay = 0; // ms the actions of the current step take
+static int idleTicks = 0; // 100 ms polls spent parked
+static bool timerStopping = false;
+static unsigned long timerStartSec, timerStartUsec, timerEndSec, timerEndUsec;
+
+// Scheduling class and CPU placement of the elevator thread (or of the state machine's steps in timer mode)
+static int rt_priority = 0;
+module_param(rt_priority, int, S_IRUGO);
+MODULE_PARM_DESC(rt_priority, "Run the elevator SCHED_FIFO at this priority, 1-99 (0 = normal scheduling)");
+
+static char *cpu_list = "";
+module_param(cpu_list, charp, S_IRUGO);
+MODULE_PARM_DESC(cpu_list, "CPUs the elevator runs on, e.g. \"2\" or \"2-3\" (empty = any CPU)");
+
+static struct cpumask elevatorCpus; // online CPUs in cpu_list
+// Online CPUs outside cpu_list, or all of them if it names every online CPU: the arrival generator and the sampler run
+// there so they don't take time from the elevator
+static struct cpumask backgroundCpus;
+
+void getCurrentTime(struct timeval, unsigned long*, unsigned long*);
+
+// elevator function prototypes
+void initializeShaftArray(void);
+void initializeElevatorCar(void);
+int addPassengertoQueue(int, int, int, riderFile*);
+unsigned int travelTime(int);
+void enterElevator(passengerNode*);
+int splitGroup(passengerNode*, int);
+int parkingFloor(void);
+int reserveSlots(int);
+void releaseSlots(int);
+void freeRider(struct kref*);
+int riderDone(riderFile*);
+void publishStats(void);
+
+// active floor index prototypes
+void initializeFloorIndex(floorIndex*);
+int lowerId(int, int);
+void indexSet(floorIndex*, int, int);
+int indexPriority(floorIndex*, int);
+int cachedAnswer(floorIndex*, int, int);
+void cacheAnswer(floorIndex*, int, int, int, int, int);
+int indexNext(floorIndex*, int, int);
+int cachedNext(floorIndex*, int, int);
+int indexLowest(floorIndex*);
+
+// sampler function prototypes
+int sampler_init(void);
+void sampler_cleanup(void);
+void takeSample(struct work_struct*);
+
+// arrival generator prototypes
+int parseGenerator(void);
+int generator_init(void);
+void generator_cleanup(void);
+int generator_fn(void*);
+int generatorFloor(int, int);
+void generatePassenger(int*, int*);
+u64 generatorGap(u64);
+
+// decision profiler prototypes
+void profile_counters_init(struct task_struct*);
+void profile_counters_cleanup(void);
+void readProfileCounters(u64*);
+void elevatorSleep(unsigned int);
+int decideAction(void);
+
+// demand estimation prototypes
+void decayDemand(demandRate*, unsigned long);
+void updateDemand(int, int, int);
+
+// thread function prototypes
+int thread_init(void);
+void thread_cleanup(void);
+
+// state machine function prototypes
+enum hrtimer_restart elevatorTimerFn(struct hrtimer*);
+void elevatorStep(struct work_struct*);
+int state_machine_init(void);
+void state_machine_cleanup(void);
+void queueElevatorStep(void);
+
+// placement function prototypes
+int parsePlacement(void);
+void placeElevatorThread(struct task_struct*);
+
+// data from userspace
+//static char message[256] = {0};
+
+//Automatically determined device number
+static int majorNumber;
+
+//Driver class struct ptr
+static struct class *driverClass = NULL;
+
+//Driver device struct ptr
+struct device *driverDevice = NULL;
+
+//Driver prototype functions
+static int dev_open(struct inode *, struct file *);
+static int dev_release(struct inode *, struct file *);
+static ssize_t dev_read(struct file *, char *, size_t, loff_t *);
+static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
+static unsigned int dev_poll(struct file *, poll_table *);
+static int parseRequest(const char *, size_t, size_t, int *, int *, int *);
+static int parseFloor(const char *, size_t, size_t *, int *);
+
+//Sysfs attribute prototype functions
+static ssize_t demand_show(struct device *, struct device_attribute *, char *);
+static ssize_t demand_pairs_show(struct device *, struct device_attribute *, char *);
+static DEVICE_ATTR_RO(demand);
+static DEVICE_ATTR_RO(demand_pairs);
+static ssize_t queue_show(struct device *, struct device_attribute *, char *);
+static DEVICE_ATTR_RO(queue);
+static ssize_t stats_show(struct device *, struct device_attribute *, char *);
+static DEVICE_ATTR_RO(stats);
+static ssize_t decisions_show(struct device *, struct device_attribute *, char *);
+static ssize_t printProfile(char *, size_t, const char *, const decisionProfile *);
+static DEVICE_ATTR_RO(decisions);
+
+/* Driver-operation associations
+ */
+static struct file_operations fops = {
+  .owner = THIS_MODULE, // writers can sleep in dev_write, so hold the module while the device is open
+  .open = dev_open,
+  .read = dev_read,
+  .write = dev_write,
+  .poll = dev_poll,
+  .release = dev_release,
+};
+
+/* Initialization function, called from the policy's module init
+ */
+int elevator_init(void) {
+  printk(KERN_INFO "%s: initializing\n", elevatorName);
+
+  if (parsePlacement() < 0) {
+    printk(KERN_ALERT "%s: rt_priority must be 0-99 and cpu_list must name online CPUs\n", elevatorName);
+    return -EINVAL;
+  }
+
+  if (parseGenerator() < 0) {
+    printk(KERN_ALERT "%s: generator_rate and generator_count can't be negative and generator_mix must be test, "
+                      "uniform, up_peak or down_peak\n", elevatorName);
+    return -EINVAL;
+  }
+
+  // dynamically allocate a major number
+  majorNumber = register_chrdev(0, elevatorName, &fops);
+
+  if (majorNumber<0) {
+    printk(KERN_ALERT "%s: failed to allocate major number\n", elevatorName);
+    return majorNumber;
+  }
+
+  printk(KERN_INFO "%s: registered with major number %d\n", elevatorName, majorNumber);
+
+  // register device class
+  driverClass = class_create(THIS_MODULE, CLASS_NAME);
+  if (IS_ERR(driverClass)) {
+    unregister_chrdev(majorNumber, elevatorName);
+    printk(KERN_ALERT "%s: failed to register device class\n", elevatorName);
+    return PTR_ERR(driverClass);
+  }
+
+  printk(KERN_INFO "%s: device class registered\n", elevatorName);
+
+  // register device driver
+  driverDevice = device_create(driverClass, NULL, MKDEV(majorNumber, 0), NULL, elevatorName);
+  if (IS_ERR(driverDevice)) {
+    // if error, cClean up
+    class_destroy(driverClass); unregister_chrdev(majorNumber, elevatorName);
+    printk(KERN_ALERT "%s: failed to create device\n", elevatorName);
+    return PTR_ERR(driverDevice);
+  }
+
+  // expose demand estimates as /sys/class/myclass/<module_name>/demand and demand_pairs, the backpressure counters
+  // as queue, the elevator statistics as stats and the decision profiles as decisions
+  if (device_create_file(driverDevice, &dev_attr_demand) || device_create_file(driverDevice, &dev_attr_demand_pairs)
+      || device_create_file(driverDevice, &dev_attr_queue) || device_create_file(driverDevice, &dev_attr_stats)
+      || device_create_file(driverDevice, &dev_attr_decisions)) {
+    device_remove_file(driverDevice, &dev_attr_stats);
+    device_remove_file(driverDevice, &dev_attr_queue);
+    device_remove_file(driverDevice, &dev_attr_demand_pairs);
+    device_remove_file(driverDevice, &dev_attr_demand);
+    device_destroy(driverClass, MKDEV(majorNumber, 0)); class_destroy(driverClass); unregister_chrdev(majorNumber, elevatorName);
+    printk(KERN_ALERT "%s: failed to create sysfs attributes\n", elevatorName);
+    return -ENOMEM;
+  }
+
+  initializeShaftArray();
+  initializeElevatorCar();
+  publishStats();
+
+  printk(KERN_INFO "%s: device class created\n", elevatorName);
+
+  sampler_init();
+
+  if (timer_mode) {
+    state_machine_init();
+  }
+  else {
+    thread_init();
+  }
+
+  generator_init();
+
+  return 0;
+}
+
+void elevator_exit(void) {
+  generator_cleanup();
+  if (timer_mode) {
+    state_machine_cleanup();
+  }
+  else {
+    thread_cleanup();
+  }
+  sampler_cleanup();
+  // remove sysfs attributes
+  device_remove_file(driverDevice, &dev_attr_decisions);
+  device_remove_file(driverDevice, &dev_attr_stats);
+  device_remove_file(driverDevice, &dev_attr_queue);
+  device_remove_file(driverDevice, &dev_attr_demand_pairs);
+  device_remove_file(driverDevice, &dev_attr_demand);
+  // remove device
+  device_destroy(driverClass, MKDEV(majorNumber, 0));
+  // unregister device class
+  class_unregister(driverClass);
+  // remove device class
+  class_destroy(driverClass);
+  // unregister major number
+  unregister_chrdev(majorNumber, elevatorName);
+  printk(KERN_INFO "%s: closed\n", elevatorName);
+}
+
+/* Called each time the device is opened.
+ * inodep = pointer to inode
+ * filep = pointer to file object
+*/
+
+static int dev_open(struct inode *inodep, struct file *filep) {
+  riderFile *rider = kmalloc(sizeof(*rider), GFP_KERNEL);
+
+  if (rider == NULL) {
+    return -ENOMEM;
+  }
+  kref_init(&rider->ref);
+  atomic_set(&rider->delivered, 0);
+  filep->private_data = rider;
+
+  printk(KERN_INFO "%s: opened\n", elevatorName);
+  return 0;
+}
+
+/* Called when device is read.
+* filep = pointer to a file
+* buffer = pointer to the buffer to which this function writes the data
+* len = length of buffer
+* offset = offset in buffer
+*/
+static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset) {
+  riderFile *rider = filep->private_data;
+  char reply[16];
+  int delivered, length;
+
+  // Wait for a drop off of a passenger written to this descriptor, then report every one since the last read
+  do {
+    if (riderDone(rider)) {
+      return 0; // none of its passengers are left in the system, waiting would never end
+    }
+    if (atomic_read(&rider->delivered) == 0 && atomic_read(&elevatorFinished)) {
+      return -ESHUTDOWN; // nothing left to deliver
+    }
+    if (atomic_read(&rider->delivered) == 0 && (filep->f_flags & O_NONBLOCK)) {
+      return -EAGAIN;
+    }
+    if (wait_event_interruptible(deliveryQueue,
+                                 atomic_read(&rider->delivered) > 0 || atomic_read(&elevatorFinished))) {
+      return -ERESTARTSYS;
+    }
+    delivered = atomic_xchg(&rider->delivered, 0);
+  } while (delivered == 0); // another reader of the same descriptor took them
+
+  length = scnprintf(reply, sizeof(reply), "%d\n", delivered);
+  if (len < (size_t)length || copy_to_user(buffer, reply, length)) {
+    atomic_add(delivered, &rider->delivered);
+    return len < (size_t)length ? -EINVAL : -EFAULT;
+  }
+
+  return length;
+}
+
+/* Called whenever device is written.
+* filep = pointer to file
+* buffer = pointer to buffer that contains data to write to the device
+* len = length of data
+* offset = offset in buffer
+*/
+
+static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset) {
+  int origin, destination, riders = 1;
+  int reserved, error;
+  char request[REQUEST_LENGTH];
+  size_t count = min(len, sizeof(request));
+
+  // Only the first count bytes are ever read; older clients pad requests with NULs, which is fine
+  if (copy_from_user(request, buffer, count)) {
+    return -EFAULT;
+  }
+
+  if (parseRequest(request, count, len, &origin, &destination, &riders) < 0
+      || riders < 1 || riders > MAX_GROUP || (max_queue_depth > 0 && riders > max_queue_depth)) {
+    atomic_inc(&rejectedCount);
+    return -EINVAL;
+  }
+
+  if (atomic_read(&elevatorFinished)) {
+    return -ESHUTDOWN;
+  }
+
+  // Wait for room in the elevator system for the whole group, or fail right away for non blocking writers
+  if (!reserveSlots(riders)) {
+    atomic_inc(&throttledCount);
+    if (filep->f_flags & O_NONBLOCK) {
+      return -EAGAIN;
+    }
+    reserved = 0;
+    if (wait_event_interruptible(writeQueue,
+                                 (reserved = reserveSlots(riders)) || atomic_read(&elevatorFinished))) {
+      return -ERESTARTSYS;
+    }
+    if (!reserved) {
+      return -ESHUTDOWN;
+    }
+  }
+
+  error = addPassengertoQueue(origin, destination, riders, filep->private_data);
+  if (error != 0) {
+    releaseSlots(riders);
+    if (error == -ESHUTDOWN) {
+      return error;
+    }
+    atomic_inc(&rejectedCount);
+    return -EINVAL;
+  }
+
+  updateDemand(origin, destination, riders);
+
+  if (firstOrigin < 0) {
+    firstOrigin = origin;
+  }
+
+  return len;
+}
+
+/* Parses the count bytes of a request that was len bytes long: "origin,destination" for one passenger or
+* "origin,destination,riders" for a group, optionally followed by a newline or NUL padding.
+* riders is left alone if the request doesn't give it. Returns 0 on success, -EINVAL if the request is malformed.
+*/
+static int parseRequest(const char *request, size_t count, size_t len, int *origin, int *destination, int *riders) {
+  size_t index = 0;
+
+  if (parseFloor(request, count, &index, origin) < 0 || index == count || request[index++] != ','
+      || parseFloor(request, count, &index, destination) < 0) {
+    return -EINVAL;
+  }
+
+  if (index < count && request[index] == ',') {
+    index++;
+    if (parseFloor(request, count, &index, riders) < 0) {
+      return -EINVAL;
+    }
+  }
+
+  if ((index < count && request[index] != '\n' && request[index] != 0) || (index == count && len > count)) {
+    return -EINVAL;
+  }
+
+  return 0;
+}
+
+/* Parses a decimal floor number at request[*index], never reading past len.
+* Advances *index past the digits; returns 0 on success, -EINVAL if there are no digits or the number overflows.
+*/
+static int parseFloor(const char *request, size_t len, size_t *index, int *value) {
+  int digits = 0;
+
+  *value = 0;
+  while (*index < len && request[*index] >= '0' && request[*index] <= '9') {
+    if (*value > (INT_MAX - 9) / 10) {
+      return -EINVAL;
+    }
+    *value = *value * 10 + (request[*index] - '0');
+    (*index)++;
+    digits++;
+  }
+
+  return digits > 0 ? 0 : -EINVAL;
+}
+
+/* Called by poll()/select() on the device.
+* Reports the device writable while there is room for another passenger.
+*/
+static unsigned int dev_poll(struct file *filep, poll_table *wait) {
+  riderFile *rider = filep->private_data;
+  unsigned int mask = 0;
+
+  poll_wait(filep, &writeQueue, wait);
+  poll_wait(filep, &deliveryQueue, wait);
+  if (max_queue_depth <= 0 || atomic_read(&passengersInSystem) < max_queue_depth) {
+    mask |= POLLOUT | POLLWRNORM;
+  }
+  // Same rule as dev_read: a read returns a count, or end of file once the descriptor has no passengers left
+  if (atomic_read(&rider->delivered) > 0 || riderDone(rider)) {
+    mask |= POLLIN | POLLRDNORM;
+  }
+  if (atomic_read(&elevatorFinished)) {
+    mask |= POLLHUP | POLLERR; // writes would fail right away
+  }
+
+  return mask;
+}
+
+/* Called when device is closed/released. * inodep = pointer to inode
+* filep = pointer to a file
+*/
+static int dev_release(struct inode *inodep, struct file *filep) {
+  riderFile *rider = filep->private_data;
+
+  // Passengers still in the system keep the rider until they are dropped off
+  kref_put(&rider->ref, freeRider);
+  printk(KERN_INFO "%s: released\n", elevatorName);
+  return 0;
+}
+
+/* Called when /sys/class/myclass/<module_name>/queue is read.
+* Prints the passengers waiting or riding, the limit, how many writes were rejected or had to wait for room, and how
+* many passengers the arrival generator added.
+*/
+static ssize_t queue_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  return scnprintf(buf, PAGE_SIZE, "depth %d\nmax_depth %d\nrejected %d\nthrottled %d\ngenerated %d\n",
+                   atomic_read(&passengersInSystem), max_queue_depth,
+                   atomic_read(&rejectedCount), atomic_read(&throttledCount), atomic_read(&generatedCount));
+}
+
+/* Called when /sys/class/myclass/<module_name>/stats is read.
+* Copies the last published statistics without locking, retrying if the elevator published new ones meanwhile.
+*/
+static ssize_t stats_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  elevatorStats stats;
+  unsigned int seq;
+  int i;
+  ssize_t count;
+
+  do {
+    seq = read_seqcount_begin(&statsSeq);
+    stats = statsSnapshot;
+  } while (read_seqcount_retry(&statsSeq, seq));
+
+  count = scnprintf(buf, PAGE_SIZE, "queued %d\nriding %d\nfloor %d\ndelivered %lu\nfloors_traveled %lu\nstops %lu\ndepths",
+                    stats.queued, stats.riding, stats.current_floor, stats.delivered, stats.floorsTraveled, stats.stops);
+  for (i=0; i<NUM_FLOORS; i++) {
+    count += scnprintf(buf + count, PAGE_SIZE - count, " %d", stats.floorDepth[i]);
+  }
+  count += scnprintf(buf + count, PAGE_SIZE - count, "\n");
+
+  return count;
+}
+
+// Format one decision profile for decisions_show
+static ssize_t printProfile(char *buf, size_t size, const char *name, const decisionProfile *profile) {
+  int i;
+  ssize_t count;
+
+  count = scnprintf(buf, size, "policy %s\ndecisions %lu\nrecomputed %lu\nmean_ns %llu\nmax_ns %llu\nhistogram\n",
+                    name, profile->count, profile->recomputed,
+                    profile->count ? div64_u64(profile->totalNs, profile->count) : 0ULL, profile->maxNs);
+  for (i=0; i<PROFILE_BUCKETS - 1; i++) {
+    count += scnprintf(buf + count, size - count, "< %d ns: %lu\n", PROFILE_MIN_NS << i, profile->buckets[i]);
+  }
+  count += scnprintf(buf + count, size - count, ">= %d ns: %lu\n", PROFILE_MIN_NS << (PROFILE_BUCKETS - 2),
+                     profile->buckets[PROFILE_BUCKETS - 1]);
+
+  if (profile_counters && profile->count > 0) {
+    for (i=0; i<PROFILE_COUNTERS; i++) {
+      count += scnprintf(buf + count, size - count, "%s %llu\n", profileEventNames[i],
+                         div64_u64(profile->counterTotals[i], profile->count));
+    }
+  }
+
+  return count;
+}
+
+/* Called when /sys/class/myclass/<module_name>/decisions is read.
+* Prints, for the module's policy and any other algorithm that made decisions, how many it made, their mean and
+* maximum cost in ns, a histogram of their cost, and with profile_counters the mean hardware counts per decision.
+*/
+static ssize_t decisions_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  decisionProfile profiles[NUM_POLICIES];
+  unsigned int seq;
+  int i;
+  ssize_t count = 0;
+
+  do {
+    seq = read_seqcount_begin(&profileSeq);
+    memcpy(profiles, decisionProfiles, sizeof(profiles));
+  } while (read_seqcount_retry(&profileSeq, seq));
+
+  for (i=0; i<NUM_POLICIES; i++) {
+    if (i == elevatorPolicy || profiles[i].count > 0) {
+      count += printProfile(buf + count, PAGE_SIZE - count, policyNames[i], &profiles[i]);
+    }
+  }
+
+  return count;
+}
+
+/* Called when /sys/class/myclass/<module_name>/demand is read.
+* Prints one line per floor: floor number and estimated arrivals per minute from that floor.
+*/
+static ssize_t demand_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  int i;
+  unsigned long rate;
+  ssize_t count = 0;
+
+  for (i=0; i<NUM_FLOORS; i++) {
+    rate = floorDemand(i);
+    count += scnprintf(buf + count, PAGE_SIZE - count, "%d %lu.%02lu\n", i,
+                       rate >> DEMAND_SHIFT, ((rate & ((1 << DEMAND_SHIFT) - 1)) * 100) >> DEMAND_SHIFT);
+  }
+
+  return count;
+}
+
+/* Called when /sys/class/myclass/<module_name>/demand_pairs is read.
+* Prints a NUM_FLOORS x NUM_FLOORS matrix; row = origin floor, column = destination floor,
+* each entry is the estimated arrivals per minute for that trip.
+*/
+static ssize_t demand_pairs_show(struct device *dev, struct device_attribute *attr, char *buf) {
+  int i, j;
+  unsigned long rate;
+  ssize_t count = 0;
+
+  for (i=0; i<NUM_FLOORS; i++) {
+    for (j=0; j<NUM_FLOORS; j++) {
+      rate = pairDemand(i, j);
+      count += scnprintf(buf + count, PAGE_SIZE - count, "%lu.%02lu%c",
+                         rate >> DEMAND_SHIFT, ((rate & ((1 << DEMAND_SHIFT) - 1)) * 100) >> DEMAND_SHIFT,
+                         j == NUM_FLOORS - 1 ? '\n' : ' ');
+    }
+  }
+
+  return count;
+}
+
+void getCurrentTime(struct timeval tv, long unsigned *sec, long unsigned *usec) {
+  do_gettimeofday(&tv);
+
+  *sec = tv.tv_sec;
+  *usec = tv.tv_usec;
+}
+
+void initializeShaftArray() {
+  int i;
+
+  printk(KERN_INFO "Initializing shaft array!\n");
+
+  for(i=0; i<NUM_FLOORS; i++) {
+    passengerNode* startQueue = NULL;
+    passengerNode* endQueue = NULL;
+    floorQueue new_floor = { i, startQueue, endQueue };
+    shaftArray[i] = new_floor;
+  }
+
+  initializeFloorIndex(&waitingFloors);
+}
+
+void initializeElevatorCar() {
+  int i;
+  passengerNode* init_array[NUM_FLOORS] = {0};
+
+  for(i=0; i<NUM_FLOORS; i++) {
+    passengerNode* ptr = NULL;
+    init_array[i] = ptr;
+  }
+
+  elevatorCar.current_floor = &shaftArray[0];
+  elevatorCar.passengerCount = 0;
+  memcpy(elevatorCar.passengerArray, init_array, sizeof(elevatorCar.passengerArray));
+  initializeFloorIndex(&ridingFloors);
+}
+
+int addPassengertoQueue(int origin, int destination, int riders, riderFile* rider) {
+  passengerNode* new_passenger;
+  int id;
+
+  if (origin < 0 || origin > NUM_FLOORS - 1 || destination < 0 || destination > NUM_FLOORS - 1)
+  {
+    return -1;
+  }
+
+  if ((new_passenger = (passengerNode*) kmalloc(sizeof(*new_passenger), GFP_KERNEL)) == NULL) {
+    return -1;
+  }
+
+  new_passenger->destination = destination;
+  new_passenger->count = riders;
+  new_passenger->rider = rider;
+  new_passenger->next = NULL;
+  if (rider != NULL) {
+    kref_get(&rider->ref);
+  }
+
+  spin_lock(&queueLock);
+  if (atomic_read(&elevatorFinished)) {
+    spin_unlock(&queueLock);
+    if (rider != NULL) {
+      kref_put(&rider->ref, freeRider);
+    }
+    kfree(new_passenger);
+    return -ESHUTDOWN;
+  }
+  // A group takes the ids of all its riders, so ids still count passengers; the group goes by the first
+  new_passenger->id = id = nextId;
+  nextId += riders;
+  if (shaftArray[origin].startQueue == NULL) {
+    shaftArray[origin].startQueue = new_passenger;
+    indexSet(&waitingFloors, origin, new_passenger->id);
+  }
+  else {
+    shaftArray[origin].endQueue->next = new_passenger;
+  }
+  shaftArray[origin].endQueue = new_passenger;
+  queueCount += riders;
+  atomic_add(riders, &floorDepthCount[origin]);
+  spin_unlock(&queueLock);
+
+  // The elevator may already have boarded the passenger, so don't touch new_passenger after unlocking
+  if (riders == 1) {
+    printk(KERN_INFO "Passenger id %d, floor %d -> floor %d", id, origin, destination);
+  }
+  else {
+    printk(KERN_INFO "Passengers id %d-%d, floor %d -> floor %d", id, id + riders - 1, origin, destination);
+  }
+
+  return 0;
+}
+
+/* Time in ms for one nonstop leg of floor_delta floors.
+ * The car accelerates to MAX_SPEED, cruises, and decelerates to stop at the target floor.
+ * Short legs never reach MAX_SPEED, so they are charged the triangular (accelerate then brake) profile.
+ */
+unsigned int travelTime(int floor_delta) {
+  unsigned long distance, ramp_distance, peak_speed;
+
+  if (floor_delta < 0) {
+    floor_delta *= -1;
+  }
+  if (floor_delta == 0) {
+    return 0;
+  }
+
+  distance = (unsigned long)floor_delta * FLOOR_HEIGHT;
+  ramp_distance = (unsigned long)MAX_SPEED * MAX_SPEED / (2 * ACCELERATION)
+                + (unsigned long)MAX_SPEED * MAX_SPEED / (2 * DECELERATION);
+
+  if (distance >= ramp_distance) {
+    return 1000UL * MAX_SPEED / ACCELERATION + 1000UL * MAX_SPEED / DECELERATION
+         + 1000UL * (distance - ramp_distance) / MAX_SPEED;
+  }
+
+  // The product overflows a 32-bit unsigned long even for one floor, the quotient (peak speed squared) never does
+  peak_speed = int_sqrt(div_u64((u64)2 * distance * ACCELERATION * DECELERATION, ACCELERATION + DECELERATION));
+  return 1000UL * peak_speed / ACCELERATION + 1000UL * peak_speed / DECELERATION;
+}
+
+// Move the elevator nonstop to destination_floor, sleeping once for the whole leg
+int moveElevatorTo(int destination_floor) {
+  int floor_delta;
+  unsigned int travel;
+
+  if (destination_floor < 0 || destination_floor > NUM_FLOORS - 1) {
+    return -1;
+  }
+
+  floor_delta = destination_floor - elevatorCar.current_floor->id;
+  if (floor_delta == 0) {
+    return 0;
+  }
+
+  // current_floor is the destination from here on, but samples place the car between the floors until it arrives.
+  // A step of the state machine only sleeps once its actions are done, so the move starts after the earlier ones.
+  travel = travelTime(floor_delta);
+  legFrom = elevatorCar.current_floor->id;
+  legStart = ktime_add_ms(ktime_get(), timer_mode ? pendingDelay : 0);
+  legEnd = ktime_add_ms(legStart, travel);
+
+  elevatorCar.current_floor = &shaftArray[destination_floor];
+  floorsTraveledCount += floor_delta < 0 ? -floor_delta : floor_delta;
+  publishStats();
+  elevatorSleep(travel);
+  printk(KERN_INFO "------------------------------------------Floor: %d", elevatorCar.current_floor->id);
+
+  return 0;
+}
+
+void pickUp() {
+  int delta = elevatorCapacity - elevatorCar.passengerCount;
+
+  passengerNode* current_passenger, *next_passenger;
+  current_passenger = elevatorCar.current_floor->startQueue;
+
+  // Nobody can board a full car, so don't stop and open the doors for nothing
+  if (delta <= 0 || current_passenger == NULL) {
+    return;
+  }
+
+  // Board in queue order until the car is full; whoever is left stays at the head of the floor queue
+  while (delta > 0 && current_passenger != NULL) {
+    // Only part of the group fits: the rest of it waits at the head of the queue
+    if (current_passenger->count > delta && splitGroup(current_passenger, delta) != 0) {
+      break;
+    }
+    next_passenger = current_passenger->next;
+    enterElevator(current_passenger);
+    elevatorCar.passengerCount += current_passenger->count;
+    delta -= current_passenger->count;
+    if (current_passenger->count == 1) {
+      printk(KERN_INFO "Picking up passenger %d, passenger count = %d", current_passenger->id, elevatorCar.passengerCount);
+    }
+    else {
+      printk(KERN_INFO "Picking up %d passengers of group %d, passenger count = %d", current_passenger->count,
+             current_passenger->id, elevatorCar.passengerCount);
+    }
+
+    current_passenger = next_passenger;
+  }
+
+  stopCount++;
+  publishStats();
+  elevatorSleep(1000);
+}
+
+void dropOff() {
+  int current_floor = elevatorCar.current_floor->id;
+  int dropped = 0;
+  passengerNode *head = elevatorCar.passengerArray[current_floor];
+  passengerNode *next_node;
+
+  while (head != NULL) {
+    elevatorCar.passengerCount -= head->count;
+    dropped += head->count;
+    if (head->count == 1) {
+      printk(KERN_INFO "Dropping off passenger %d, passenger count = %d", head->id, elevatorCar.passengerCount);
+    }
+    else {
+      printk(KERN_INFO "Dropping off %d passengers of group %d, passenger count = %d", head->count, head->id,
+             elevatorCar.passengerCount);
+    }
+    if (head->rider != NULL) {
+      atomic_add(head->count, &head->rider->delivered);
+      kref_put(&head->rider->ref, freeRider);
+    }
+    next_node = head->next;
+    kfree(head);
+    head = next_node;
+  }
+  elevatorCar.passengerArray[current_floor] = NULL;
+  indexSet(&ridingFloors, current_floor, 0);
+  releaseSlots(dropped);
+  if (dropped > 0) {
+    wake_up_interruptible(&deliveryQueue);
+  }
+  deliveredCount += dropped;
+  stopCount++;
+  publishStats();
+  elevatorSleep(1000);
+}
+
+void enterElevator(passengerNode* entering_passenger) {
+  int dest = entering_passenger->destination;
+
+  spin_lock(&queueLock);
+  elevatorCar.current_floor->startQueue = entering_passenger->next;
+  if (elevatorCar.current_floor->startQueue == NULL) {
+    elevatorCar.current_floor->endQueue = NULL;
+    indexSet(&waitingFloors, elevatorCar.current_floor->id, 0);
+  }
+  else {
+    indexSet(&waitingFloors, elevatorCar.current_floor->id, elevatorCar.current_floor->startQueue->id);
+  }
+  queueCount -= entering_passenger->count;
+  atomic_sub(entering_passenger->count, &floorDepthCount[elevatorCar.current_floor->id]);
+  spin_unlock(&queueLock);
+
+  if (elevatorCar.passengerArray[dest] == NULL) {
+    elevatorCar.passengerArray[dest] = entering_passenger;
+    entering_passenger->next = NULL;
+  }
+  else {
+    if (elevatorCar.passengerArray[dest]->id > entering_passenger->id) {
+      entering_passenger->next =  elevatorCar.passengerArray[dest];
+      elevatorCar.passengerArray[dest] = entering_passenger;
+    }
+    else {
+      entering_passenger->next =  elevatorCar.passengerArray[dest]->next;
+      elevatorCar.passengerArray[dest]->next = entering_passenger;
+
+    }
+  }
+  indexSet(&ridingFloors, dest, elevatorCar.passengerArray[dest]->id);
+}
+
+/* Split the first riders of a group waiting at the current floor off into a node of their own, so they can board
+ * without the rest: the rest of the group becomes the next node in the floor queue, with the same id.
+ * Returns 0 on success, -1 if there is no memory for the new node.
+ */
+int splitGroup(passengerNode* group, int riders) {
+  passengerNode* rest;
+
+  if ((rest = (passengerNode*) kmalloc(sizeof(*rest), GFP_KERNEL)) == NULL) {
+    return -1;
+  }
+
+  rest->id = group->id;
+  rest->destination = group->destination;
+  rest->rider = group->rider;
+  if (rest->rider != NULL) {
+    kref_get(&rest->rider->ref);
+  }
+
+  spin_lock(&queueLock);
+  rest->count = group->count - riders;
+  group->count = riders;
+  rest->next = group->next;
+  group->next = rest;
+  if (elevatorCar.current_floor->endQueue == group) {
+    elevatorCar.current_floor->endQueue = rest;
+  }
+  spin_unlock(&queueLock);
+
+  return 0;
+}
+
+int existsPassengerNode(){
+  if (queueCount == 0 && elevatorCar.passengerCount == 0)
+    return 0;
+  return 1;
+}
+
+// Waiting passengers can't be served while the car is full, so hall calls only count as stops when this is 0
+int elevatorFull() {
+  return elevatorCar.passengerCount >= elevatorCapacity;
+}
+
+void initializeFloorIndex(floorIndex *index) {
+  index->leaves = 1;
+  while (index->leaves < NUM_FLOORS) {
+    index->leaves *= 2;
+  }
+  memset(index->minId, 0, sizeof(index->minId));
+  bitmap_zero(index->dirty, NUM_FLOORS);
+  index->cache.query = QUERY_NONE;
+}
+
+// Lower of two ids where 0 means no passenger. Compared as unsigned, 0 - 1 is the largest value so it never wins,
+// and the compiler needs no branch that random ids would keep mispredicting.
+int lowerId(int a, int b) {
+  return (unsigned int)a - 1 < (unsigned int)b - 1 ? a : b;
+}
+
+// Set the lowest passenger id on floor (0 if it has no work) and update the ranges above it
+void indexSet(floorIndex *index, int floor, int id) {
+  int node = index->leaves + floor;
+
+  // Enqueues (dev_write), boarding (pickUp) and drop offs all come through here, so this flags every event
+  set_bit(floor, index->dirty);
+  index->minId[node] = id;
+  if (NUM_FLOORS < INDEX_MIN_FLOORS) {
+    return;
+  }
+  for (node /= 2; node >= 1; node /= 2) {
+    id = lowerId(index->minId[2 * node], index->minId[2 * node + 1]);
+    // The ranges further up only see this one through its lowest id, so they stay the same if it does
+    if (index->minId[node] == id) {
+      break;
+    }
+    index->minId[node] = id;
+  }
+}
+
+// Lowest passenger id on floor, 0 if it has no work
+int indexPriority(floorIndex *index, int floor) {
+  return index->minId[index->leaves + floor];
+}
+
+/* Cached answer to query from floor, or CACHE_MISS if nothing is cached for them or one of the floors the answer
+ * depends on has changed since. Caller must hold queueLock for waitingFloors.
+ */
+int cachedAnswer(floorIndex *index, int query, int floor) {
+  indexCache *cache = &index->cache;
+
+  if (cache->query != query || cache->from != floor) {
+    return CACHE_MISS;
+  }
+  if (cache->low <= cache->high && find_next_bit(index->dirty, cache->high + 1, cache->low) <= cache->high) {
+    return CACHE_MISS;
+  }
+
+  return cache->answer;
+}
+
+// Remember the answer to query from floor and the floors low..high it depends on, and track changes from now on
+void cacheAnswer(floorIndex *index, int query, int floor, int answer, int low, int high) {
+  indexCache *cache = &index->cache;
+
+  cache->query = query;
+  cache->from = floor;
+  cache->low = low < 0 ? 0 : low;
+  cache->high = high > NUM_FLOORS - 1 ? NUM_FLOORS - 1 : high;
+  cache->answer = answer;
+  bitmap_zero(index->dirty, NUM_FLOORS);
+  indexSearches++;
+}
+
+// Closest floor with work strictly above (direction 1) or below (direction -1) floor, or -1 if there is none
+int indexNext(floorIndex *index, int floor, int direction) {
+  int node = index->leaves + floor;
+  int sibling;
+
+  if (NUM_FLOORS < INDEX_MIN_FLOORS) {
+    for (floor += direction; floor >= 0 && floor < NUM_FLOORS; floor += direction) {
+      if (index->minId[index->leaves + floor] != 0) {
+        return floor;
+      }
+    }
+    return -1;
+  }
+
+  // Climb until the sibling range on the direction side has work
+  while (node > 1) {
+    sibling = direction > 0 ? node + 1 : node - 1;
+    if ((direction > 0 ? node % 2 == 0 : node % 2 == 1) && index->minId[sibling] != 0) {
+      break;
+    }
+    node /= 2;
+  }
+  if (node == 1) {
+    return -1;
+  }
+
+  // Then descend into it, keeping to the child nearest floor that has work
+  node = sibling;
+  while (node < index->leaves) {
+    if (direction > 0) {
+      node = index->minId[2 * node] != 0 ? 2 * node : 2 * node + 1;
+    }
+    else {
+      node = index->minId[2 * node + 1] != 0 ? 2 * node + 1 : 2 * node;
+    }
+  }
+
+  return node - index->leaves;
+}
+
+// indexNext through the cache. Caller must hold queueLock for waitingFloors.
+int cachedNext(floorIndex *index, int floor, int direction) {
+  int next = cachedAnswer(index, direction, floor);
+  int reach;
+
+  if (next == CACHE_MISS) {
+    next = indexNext(index, floor, direction);
+    // Only the floors from the car to the answer, or to the end of the shaft if there is none, can change it
+    reach = next >= 0 ? next : (direction > 0 ? NUM_FLOORS - 1 : 0);
+    if (direction > 0) {
+      cacheAnswer(index, direction, floor, next, floor + 1, reach);
+    }
+    else {
+      cacheAnswer(index, direction, floor, next, reach, floor - 1);
+    }
+  }
+
+  return next;
+}
+
+// Floor with the lowest passenger id, or -1 if no floor has work
+int indexLowest(floorIndex *index) {
+  int node = 1;
+  int floor, lowest = -1;
+
+  if (NUM_FLOORS < INDEX_MIN_FLOORS) {
+    for (floor = 0; floor < NUM_FLOORS; floor++) {
+      if (index->minId[index->leaves + floor] != 0
+          && (lowest < 0 || index->minId[index->leaves + floor] < index->minId[index->leaves + lowest])) {
+        lowest = floor;
+      }
+    }
+    return lowest;
+  }
+
+  if (index->minId[1] == 0) {
+    return -1;
+  }
+
+  while (node < index->leaves) {
+    node = index->minId[2 * node] == index->minId[node] ? 2 * node : 2 * node + 1;
+  }
+
+  return node - index->leaves;
+}
+
+// indexLowest through the cache: it doesn't depend on where the car is, but a change on any floor can change it.
+// Caller must hold queueLock for waitingFloors.
+int cachedLowest(floorIndex *index) {
+  int lowest = cachedAnswer(index, QUERY_LOWEST, 0);
+
+  if (lowest == CACHE_MISS) {
+    lowest = indexLowest(index);
+    cacheAnswer(index, QUERY_LOWEST, 0, lowest, 0, NUM_FLOORS - 1);
+  }
+
+  return lowest;
+}
+
+/* Reserve room for riders more passengers, all or none. Returns 1 on success, 0 if that would put more than
+ * max_queue_depth passengers in the system.
+ */
+int reserveSlots(int riders) {
+  int depth = max_queue_depth;
+  int current, old;
+
+  current = atomic_read(&passengersInSystem);
+  while (depth <= 0 || current + riders <= depth) {
+    old = atomic_cmpxchg(&passengersInSystem, current, current + riders);
+    if (old == current) {
+      return 1;
+    }
+    current = old;
+  }
+
+  return 0;
+}
+
+// Give back the room of count passengers and wake up writers waiting for it
+void releaseSlots(int count) {
+  if (count > 0) {
+    atomic_sub(count, &passengersInSystem);
+    wake_up_interruptible(&writeQueue);
+  }
+}
+
+// Stop the elevator for good unless a passenger was queued since it went idle. Returns 1 if it stopped; writes
+// fail from then on, and readers and writers that are waiting wake up to fail as well
+int finishElevator(void) {
+  int finished = 0;
+
+  spin_lock(&queueLock);
+  if (queueCount == 0) {
+    atomic_set(&elevatorFinished, 1);
+    finished = 1;
+  }
+  spin_unlock(&queueLock);
+
+  if (finished) {
+    wake_up_interruptible(&writeQueue);
+    wake_up_interruptible(&deliveryQueue);
+  }
+
+  return finished;
+}
+
+/* 1 if none of the passengers written to rider are left in the system and every drop off has been read: the descriptor
+ * holds the only reference, since each passenger holds one until it is delivered.
+ */
+int riderDone(riderFile *rider) {
+  if (kref_read(&rider->ref) > 1) {
+    return 0;
+  }
+  smp_rmb(); // dropOff adds to delivered before it drops the passenger's reference
+  return atomic_read(&rider->delivered) == 0;
+}
+
+// Called when the last reference to a rider is dropped: its descriptor is closed and all its passengers delivered
+void freeRider(struct kref *ref) {
+  kfree(container_of(ref, riderFile, ref));
+}
+
+/* Publish the elevator's state for stats_show. Only the elevator calls this, after each move, pick up and drop off.
+ * Floor depths are counted before the write section so readers retry as rarely as possible.
+ */
+void publishStats() {
+  int i;
+  int depth[NUM_FLOORS];
+
+  for (i=0; i<NUM_FLOORS; i++) {
+    depth[i] = atomic_read(&floorDepthCount[i]);
+  }
+
+  preempt_disable();
+  write_seqcount_begin(&statsSeq);
+  statsSnapshot.queued = queueCount;
+  statsSnapshot.riding = elevatorCar.passengerCount;
+  statsSnapshot.current_floor = elevatorCar.current_floor->id;
+  statsSnapshot.delivered = deliveredCount;
+  statsSnapshot.floorsTraveled = floorsTraveledCount;
+  statsSnapshot.stops = stopCount;
+  memcpy(statsSnapshot.floorDepth, depth, sizeof(depth));
+  statsSnapshot.leg_from = legFrom;
+  statsSnapshot.leg_start = legStart;
+  statsSnapshot.leg_end = legEnd;
+  write_seqcount_end(&statsSeq);
+  preempt_enable();
+}
+
+// Bring an estimate up to date by applying one 1/32 decay per DEMAND_PERIOD elapsed since it was last touched.
+// Caller must hold demandLock.
+void decayDemand(demandRate *demand, unsigned long now) {
+  unsigned long periods;
+  int k;
+
+  if (demand->rate == 0) {
+    demand->stamp = now;
+    return;
+  }
+
+  periods = (now - demand->stamp) / msecs_to_jiffies(DEMAND_PERIOD);
+  if (periods == 0) {
+    return;
+  }
+  demand->stamp += periods * msecs_to_jiffies(DEMAND_PERIOD);
+
+  for (k=0; periods != 0; k++, periods >>= 1) {
+    // After 2^ARRAY_SIZE(demandDecay) periods nothing measurable is left
+    if (k == ARRAY_SIZE(demandDecay)) {
+      demand->rate = 0;
+      break;
+    }
+    if (periods & 1) {
+      demand->rate = ((u64)demand->rate * demandDecay[k]) >> 16;
+    }
+  }
+}
+
+// Record riders arrivals from origin to destination; called from dev_write and the arrival generator
+void updateDemand(int origin, int destination, int riders) {
+  unsigned long now = jiffies;
+
+  spin_lock(&demandLock);
+  decayDemand(&floorDemandArray[origin], now);
+  floorDemandArray[origin].rate += DEMAND_INCREMENT * riders;
+  decayDemand(&pairDemandArray[origin][destination], now);
+  pairDemandArray[origin][destination].rate += DEMAND_INCREMENT * riders;
+  spin_unlock(&demandLock);
+}
+
+// Estimated arrivals per minute (<< DEMAND_SHIFT) from floor_num
+unsigned long floorDemand(int floor_num) {
+  unsigned long rate;
+
+  if (floor_num < 0 || floor_num > NUM_FLOORS - 1) {
+    return 0;
+  }
+
+  spin_lock(&demandLock);
+  decayDemand(&floorDemandArray[floor_num], jiffies);
+  rate = floorDemandArray[floor_num].rate;
+  spin_unlock(&demandLock);
+
+  return rate;
+}
+
+// Estimated arrivals per minute (<< DEMAND_SHIFT) travelling from origin to destination
+unsigned long pairDemand(int origin, int destination) {
+  unsigned long rate;
+
+  if (origin < 0 || origin > NUM_FLOORS - 1 || destination < 0 || destination > NUM_FLOORS - 1) {
+    return 0;
+  }
+
+  spin_lock(&demandLock);
+  decayDemand(&pairDemandArray[origin][destination], jiffies);
+  rate = pairDemandArray[origin][destination].rate;
+  spin_unlock(&demandLock);
+
+  return rate;
+}
+
+// Floor to park at when there is no work: the configured park_floor,
+// or else the floor with the highest estimated arrival rate (lowest floor on ties)
+int parkingFloor() {
+  int i;
+  int busiest_floor = 0;
+  unsigned long demand, busiest_demand;
+
+  if (park_floor >= 0 && park_floor < NUM_FLOORS) {
+    return park_floor;
+  }
+
+  busiest_demand = floorDemand(0);
+  for (i=1; i<NUM_FLOORS; i++) {
+    demand = floorDemand(i);
+    if (demand > busiest_demand) {
+      busiest_demand = demand;
+      busiest_floor = i;
+    }
+  }
+
+  return busiest_floor;
+}
+
+// Called once the queue drains: records when that happened, moves the elevator to its parking floor
+// and waits up to idle_timeout seconds for a new passenger. Returns 1 if there is new work, 0 otherwise.
+int waitForPassengers(unsigned long *drained_sec, unsigned long *drained_usec) {
+  struct timeval tv;
+  int counter = 0;
+  int home_floor = parkingFloor();
+
+  getCurrentTime(tv, drained_sec, drained_usec);
+
+  if (home_floor != elevatorCar.current_floor->id) {
+    printk(KERN_INFO "Parking at floor %d", home_floor);
+    moveElevatorTo(home_floor);
+  }
+
+  while (existsPassengerNode() == 0 && counter < idle_timeout * 10) {
+    if (kthread_should_stop()) {
+      return 0;
+    }
+    msleep(100);
+    counter++;
+  }
+
+  return existsPassengerNode();
+}
+
+// Closest floor with work in index other than the current one, or -1 if there is none: only the nearest floor with
+// work above and below are looked at. Ties between floors the same distance away go to the lower id.
+int closestFloor(floorIndex *index) {
+  int current_floor = elevatorCar.current_floor->id;
+  int floor_up, floor_down, target, distance;
+
+  // Writers update waitingFloors under queueLock
+  spin_lock(&queueLock);
+  target = cachedAnswer(index, QUERY_CLOSEST, current_floor);
+  if (target == CACHE_MISS) {
+    floor_up = indexNext(index, current_floor, 1);
+    floor_down = indexNext(index, current_floor, -1);
+    if (floor_up >= 0 && (floor_down < 0 || floor_up - current_floor < current_floor - floor_down
+                          || (floor_up - current_floor == current_floor - floor_down
+                              && indexPriority(index, floor_up) < indexPriority(index, floor_down)))) {
+      target = floor_up;
+    }
+    else {
+      target = floor_down;
+    }
+    // Only floors at most as far away as the target can change it, or any floor if there is none
+    distance = target >= 0 ? abs(target - current_floor) : NUM_FLOORS;
+    cacheAnswer(index, QUERY_CLOSEST, current_floor, target, current_floor - distance, current_floor + distance);
+  }
+  spin_unlock(&queueLock);
+
+  return target;
+}
+
+// Find the next floor in the given direction where the elevator has to stop: a drop off,
+// or a floor with waiting passengers if there is room for them.
+// The sweep always runs to the top/bottom floor, so that is the stop if nothing is found before it.
+int nextStop(int direction) {
+  int current_floor = elevatorCar.current_floor->id;
+  int floor_num = current_floor + direction;
+  int waiting_floor;
+
+  if (floor_num <= 0 || floor_num >= NUM_FLOORS - 1) {
+    return floor_num;
+  }
+
+  floor_num = cachedNext(&ridingFloors, current_floor, direction);
+  if (!elevatorFull()) {
+    spin_lock(&queueLock);
+    waiting_floor = cachedNext(&waitingFloors, current_floor, direction);
+    spin_unlock(&queueLock);
+    if (waiting_floor >= 0 && (floor_num < 0 || (waiting_floor - floor_num) * direction < 0)) {
+      floor_num = waiting_floor;
+    }
+  }
+
+  if (floor_num <= 0 || floor_num >= NUM_FLOORS - 1) {
+    return direction > 0 ? NUM_FLOORS - 1 : 0;
+  }
+  return floor_num;
+}
+
+// One action of the timer driven state machine, in the same order a pass of thread_fn's loop takes them:
+// drop off here, pick up here, or start moving to the next target. Returns 0 if there is nothing to do.
+int decideAction() {
+  int current_floor = elevatorCar.current_floor->id;
+  int target;
+
+  if (elevatorCar.passengerArray[current_floor] != NULL) {
+    dropOff();
+    return 1;
+  }
+
+  if (shaftArray[current_floor].startQueue != NULL && !elevatorFull()) {
+    pickUp();
+    return 1;
+  }
+
+  target = nextTarget();
+  if (target < 0 || target == current_floor || moveElevatorTo(target) < 0) {
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Start of a thread_fn run: waits for the first request, then logs the start time into start_sec
+ * and start_usec, moves to the first passenger and picks up. Returns 0 if no request came.
+ */
+int startElevator(unsigned long *start_sec, unsigned long *start_usec) {
+  /* Structures for calculating time */
+  struct timeval tv;
+  char buffer[256];
+
+  int counter = 0; //Ensure we don't get stuck in loop if passengers aren't being created properly
+
+  // Main loop to run elevator
+  while (firstOrigin < 0 && counter < 600000){
+    msleep(1000);
+    counter++;
+  }
+
+  if (firstOrigin < 0) {
+    return 0;
+  }
+
+  //Start time
+  printk(KERN_INFO "Start time: ");
+  getCurrentTime(tv, start_sec, start_usec);
+  sprintf(buffer, "%lu sec %lu usec\n", *start_sec, *start_usec);
+  printk(KERN_INFO "%s", buffer);
+
+  moveElevatorTo(firstOrigin);
+
+  pickUp();
+
+  return 1;
+}
+
+// Log the start, end and total time of the run
+void printResults(unsigned long start_sec, unsigned long start_usec, unsigned long end_sec, unsigned long end_usec) {
+  char buffer[256];
+  unsigned long total_sec, total_usec;
+
+  printk(KERN_INFO "---- %s ALGORITHM COMPLETE ----", algorithmName);
+  printPolicyResults();
+  printk(KERN_INFO "Start time: ");
+  sprintf(buffer, "%lu sec %lu usec\n", start_sec, start_usec);
+  printk(KERN_INFO "%s", buffer);
+  printk(KERN_INFO "End time: ");
+  sprintf(buffer, "%lu sec %lu usec\n", end_sec, end_usec);
+  printk(KERN_INFO "%s", buffer);
+
+  if (end_usec < start_usec) {
+    total_sec = end_sec - 1 - start_sec;
+    total_usec = end_usec + 1000000 - start_usec;
+  }
+  else {
+    total_sec = end_sec - start_sec;
+    total_usec = end_usec - start_usec;
+  }
+
+  printk(KERN_INFO "Total sec: %lu, Total: usec: %lu", total_sec, total_usec);
+  printk(KERN_INFO "Done");
+}
+
+/* Count instructions, cache misses and branch misses of the elevator thread, if profile_counters is set.
+ * Counters that the CPU or kernel doesn't support are left out and read as 0.
+ */
+void profile_counters_init(struct task_struct *thread) {
+  struct perf_event_attr attr;
+  int i;
+
+  if (!profile_counters) {
+    return;
+  }
+
+  for (i=0; i<PROFILE_COUNTERS; i++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = profileEventConfigs[i];
+
+    profileEvents[i] = perf_event_create_kernel_counter(&attr, -1, thread, NULL, NULL);
+    if (IS_ERR(profileEvents[i])) {
+      printk(KERN_WARNING "Could not count %s: %ld", profileEventNames[i], PTR_ERR(profileEvents[i]));
+      profileEvents[i] = NULL;
+    }
+  }
+}
+
+void profile_counters_cleanup() {
+  int i;
+
+  for (i=0; i<PROFILE_COUNTERS; i++) {
+    if (profileEvents[i] != NULL) {
+      perf_event_release_kernel(profileEvents[i]);
+      profileEvents[i] = NULL;
+    }
+  }
+}
+
+void readProfileCounters(u64 *counts) {
+  u64 enabled, running;
+  int i;
+
+  for (i=0; i<PROFILE_COUNTERS; i++) {
+    counts[i] = profileEvents[i] != NULL ? perf_event_read_value(profileEvents[i], &enabled, &running) : 0;
+  }
+}
+
+// Start timing a decision. The counters are read outside the timed section, so reading them doesn't add to the ns.
+void startDecision(decisionSample *sample) {
+  readProfileCounters(sample->counts);
+  sample->searches = indexSearches;
+  sample->start = ktime_get_ns();
+}
+
+// Stop timing a decision and add it to profile
+void endDecision(decisionSample *sample, decisionProfile *profile) {
+  u64 ns = ktime_get_ns() - sample->start;
+  u64 counts[PROFILE_COUNTERS];
+  int i, bucket = 0;
+
+  readProfileCounters(counts);
+  while (bucket < PROFILE_BUCKETS - 1 && ns >= ((u64)PROFILE_MIN_NS << bucket)) {
+    bucket++;
+  }
+
+  preempt_disable();
+  write_seqcount_begin(&profileSeq);
+  profile->count++;
+  if (indexSearches != sample->searches) {
+    profile->recomputed++;
+  }
+  profile->totalNs += ns;
+  if (ns > profile->maxNs) {
+    profile->maxNs = ns;
+  }
+  profile->buckets[bucket]++;
+  for (i=0; i<PROFILE_COUNTERS; i++) {
+    profile->counterTotals[i] += counts[i] - sample->counts[i];
+  }
+  write_seqcount_end(&profileSeq);
+  preempt_enable();
+}
+
+// relay callbacks: one global buffer file in debugfs, so samples from any CPU come out in order
+static struct dentry *createSampleFile(const char *filename, struct dentry *parent, umode_t mode,
+                                       struct rchan_buf *buf, int *is_global) {
+  *is_global = 1;
+  return debugfs_create_file(filename, mode, parent, buf, &relay_file_operations);
+}
+
+static int removeSampleFile(struct dentry *dentry) {
+  debugfs_remove(dentry);
+  return 0;
+}
+
+static struct rchan_callbacks sampleCallbacks = {
+  .create_buf_file = createSampleFile,
+  .remove_buf_file = removeSampleFile,
+};
+
+// Start sampling every sample_interval ms. Sampling is optional, so failures only disable it.
+int sampler_init() {
+  if (sample_interval <= 0) {
+    return 0;
+  }
+
+  sampleDir = debugfs_create_dir(elevatorName, NULL);
+  if (IS_ERR_OR_NULL(sampleDir)) {
+    sampleDir = NULL;
+    printk(KERN_WARNING "%s: debugfs is not available, sampling disabled\n", elevatorName);
+    return -ENODEV;
+  }
+
+  sampleChannel = relay_open("samples", sampleDir, SAMPLE_SUBBUF_SIZE, SAMPLE_SUBBUFS, &sampleCallbacks, NULL);
+  if (sampleChannel == NULL) {
+    debugfs_remove_recursive(sampleDir);
+    sampleDir = NULL;
+    printk(KERN_WARNING "%s: failed to open the sample channel, sampling disabled\n", elevatorName);
+    return -ENOMEM;
+  }
+
+  sampleStart = ktime_get();
+  sampleCount = 0;
+  INIT_DELAYED_WORK(&sampleWork, takeSample);
+  queue_delayed_work_on(cpumask_first(&backgroundCpus), system_wq, &sampleWork, 0);
+
+  return 0;
+}
+
+void sampler_cleanup() {
+  if (sampleChannel == NULL) {
+    return;
+  }
+
+  cancel_delayed_work_sync(&sampleWork);
+  relay_close(sampleChannel);
+  debugfs_remove_recursive(sampleDir);
+  sampleChannel = NULL;
+  sampleDir = NULL;
+}
+
+// Check the generator parameters and look up generator_mix. Returns 0 on success, -EINVAL otherwise.
+int parseGenerator() {
+  int i;
+
+  if (generator_rate < 0 || generator_count < 0) {
+    return -EINVAL;
+  }
+
+  for (i=0; i<NUM_MIXES; i++) {
+    if (strcmp(generator_mix, mixNames[i]) == 0) {
+      generatorMix = i;
+      return 0;
+    }
+  }
+
+  return -EINVAL;
+}
+
+int generator_init() {
+  if (generator_rate <= 0) {
+    return 0;
+  }
+
+  prandom_seed_state(&generatorState, generator_seed);
+  generator_thread = kthread_create(generator_fn, NULL, "elevator-generator");
+  if (IS_ERR(generator_thread)) {
+    generator_thread = NULL;
+    printk(KERN_WARNING "%s: failed to start the arrival generator\n", elevatorName);
+    return -ENOMEM;
+  }
+
+  // Created stopped so that, like the elevator thread, it never runs before it is placed: off the elevator's CPUs
+  if (set_cpus_allowed_ptr(generator_thread, &backgroundCpus)) {
+    printk(KERN_WARNING "Could not move the arrival generator off cpus %s", cpu_list);
+  }
+  wake_up_process(generator_thread);
+
+  return 0;
+}
+
+void generator_cleanup() {
+  if (generator_thread == NULL) {
+    return;
+  }
+
+  kthread_stop(generator_thread);
+  generator_thread = NULL;
+}
+
+/* Add generator_rate passengers a minute until generator_count have been added or the module is removed.
+ * Arrival times are absolute, so a generator that falls behind (a full queue, a slow printk) catches up right away
+ * instead of lowering the rate. Passengers are admitted like dev_write admits them: each waits for room under
+ * max_queue_depth and counts in the demand estimates, but belongs to no descriptor.
+ */
+int generator_fn(void *v) {
+  u64 mean = div_u64(60ULL * NSEC_PER_SEC, generator_rate);
+  ktime_t next = ktime_get();
+  int origin, destination;
+  int reserved, error;
+
+  while (generator_count == 0 || atomic_read(&generatedCount) < generator_count) {
+    next = ktime_add_ns(next, generatorGap(mean));
+    set_current_state(TASK_INTERRUPTIBLE);
+    if (kthread_should_stop()) {
+      __set_current_state(TASK_RUNNING);
+      return 0;
+    }
+    schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+
+    generatePassenger(&origin, &destination);
+    reserved = reserveSlots(1);
+    if (!reserved) {
+      atomic_inc(&throttledCount);
+      wait_event_interruptible(writeQueue,
+                               (reserved = reserveSlots(1)) || atomic_read(&elevatorFinished) || kthread_should_stop());
+    }
+    if (kthread_should_stop()) {
+      return 0;
+    }
+    if (!reserved) {
+      break; // the elevator has finished
+    }
+
+    error = addPassengertoQueue(origin, destination, 1, NULL);
+    if (error != 0) {
+      releaseSlots(1);
+      if (error == -ESHUTDOWN) {
+        break;
+      }
+      continue;
+    }
+    updateDemand(origin, destination, 1);
+    if (firstOrigin < 0) {
+      firstOrigin = origin;
+    }
+    atomic_inc(&generatedCount);
+  }
+
+  // Done: wait for generator_cleanup to stop the thread
+  set_current_state(TASK_INTERRUPTIBLE);
+  while (!kthread_should_stop()) {
+    schedule();
+    set_current_state(TASK_INTERRUPTIBLE);
+  }
+  __set_current_state(TASK_RUNNING);
+
+  return 0;
+}
+
+// Random floor from lowest up to the top floor, other than except (-1 for none)
+int generatorFloor(int lowest, int except) {
+  int floor;
+
+  do {
+    floor = lowest + prandom_u32_state(&generatorState) % (NUM_FLOORS - lowest);
+  } while (floor == except);
+
+  return floor;
+}
+
+void generatePassenger(int *origin, int *destination) {
+  unsigned int roll = prandom_u32_state(&generatorState) % 100;
+  int floor;
+
+  switch (generatorMix) {
+    case MIX_TEST:
+      if (roll < 50) {
+        *origin = generatorFloor(1, -1);
+        *destination = generatorFloor(1, *origin);
+      }
+      else if (roll < 75) {
+        *origin = 0;
+        *destination = generatorFloor(1, -1);
+      }
+      else {
+        *origin = generatorFloor(1, -1);
+        *destination = 0;
+      }
+      break;
+
+    case MIX_UNIFORM:
+      *origin = generatorFloor(0, -1);
+      *destination = generatorFloor(0, *origin);
+      break;
+
+    default:
+      // Up-peak: most trips leave the ground floor, the rest are split between going down to it and inter-floor
+      if (roll < PEAK_SHARE) {
+        *origin = 0;
+        *destination = generatorFloor(1, -1);
+      }
+      else if (roll < PEAK_SHARE + (100 - PEAK_SHARE) / 2) {
+        *origin = generatorFloor(1, -1);
+        *destination = 0;
+      }
+      else {
+        *origin = generatorFloor(1, -1);
+        *destination = generatorFloor(1, *origin);
+      }
+
+      // Down-peak is the same trips the other way
+      if (generatorMix == MIX_DOWN_PEAK) {
+        floor = *origin;
+        *origin = *destination;
+        *destination = floor;
+      }
+  }
+}
+
+/* ns until the next arrival, for a mean gap of mean ns.
+ * Poisson arrivals have exponential gaps, mean * -ln(u) for u uniform in (0, 1]. With no floating point in the
+ * kernel, -ln(u) = -log2(u) * ln(2) is worked out in 16.16 fixed point: the integer part of log2 from the highest set
+ * bit, then 16 fraction bits by repeatedly squaring the mantissa.
+ */
+u64 generatorGap(u64 mean) {
+  u32 u;
+  u64 mantissa, neg_log2;
+  unsigned int fraction = 0;
+  int i, msb;
+
+  if (!generator_poisson) {
+    return mean;
+  }
+
+  u = prandom_u32_state(&generatorState) | 1; // u / 2^32, never 0
+  msb = fls(u) - 1;
+  mantissa = (u64)u << (31 - msb); // u / 2^msb in [1, 2), 1.31 fixed point
+  for (i=0; i<16; i++) {
+    mantissa = (mantissa * mantissa) >> 31;
+    fraction <<= 1;
+    if (mantissa >= (1ULL << 32)) {
+      fraction |= 1;
+      mantissa >>= 1;
+    }
+  }
+
+  // -log2(u / 2^32) = 32 - (msb + fraction)
+  neg_log2 = ((u64)(32 - msb) << 16) - fraction;
+  return mul_u64_u32_shr(mean, (u32)((neg_log2 * LN2_FIXED) >> 16), 16);
+}
+
+/* Write one sample line to the relay channel and schedule the next one.
+ * Car floor and load come from the published statistics; floor queues from floorDepthCount, which dev_write
+ * updates right away. Samples are due at fixed multiples of sample_interval, so late ones don't shift the rest.
+ */
+void takeSample(struct work_struct *work) {
+  char line[SAMPLE_LINE_LENGTH];
+  elevatorStats stats;
+  unsigned int seq;
+  int i, floor;
+  size_t len;
+  s64 now, next;
+  ktime_t when;
+
+  do {
+    seq = read_seqcount_begin(&statsSeq);
+    stats = statsSnapshot;
+  } while (read_seqcount_retry(&statsSeq, seq));
+
+  // A car on its way is placed between the floors it left and is heading to, in proportion to the time gone by
+  when = ktime_get();
+  floor = stats.current_floor;
+  if (ktime_before(when, stats.leg_end)) {
+    floor = stats.leg_from;
+    if (ktime_after(when, stats.leg_start)) {
+      floor += div64_s64((s64)(stats.current_floor - stats.leg_from) * ktime_to_ns(ktime_sub(when, stats.leg_start)),
+                         ktime_to_ns(ktime_sub(stats.leg_end, stats.leg_start)));
+    }
+  }
+
+  now = ktime_to_ms(ktime_sub(when, sampleStart));
+  len = scnprintf(line, sizeof(line), "%lld %d %d", now, floor, stats.riding);
+  for (i=0; i<NUM_FLOORS; i++) {
+    len += scnprintf(line + len, sizeof(line) - len, " %d", atomic_read(&floorDepthCount[i]));
+  }
+  len += scnprintf(line + len, sizeof(line) - len, "\n");
+  relay_write(sampleChannel, line, len);
+
+  sampleCount++;
+  next = (s64)sampleCount * sample_interval;
+  queue_delayed_work_on(cpumask_first(&backgroundCpus), system_wq, &sampleWork,
+                        next > now ? msecs_to_jiffies(next - now) : 0);
+}
+
+// Check rt_priority and parse cpu_list into elevatorCpus. Returns 0 on success, -EINVAL otherwise.
+int parsePlacement() {
+  if (rt_priority < 0 || rt_priority > MAX_RT_PRIO - 1) {
+    return -EINVAL;
+  }
+
+  if (cpu_list == NULL || cpu_list[0] == 0) {
+    cpumask_copy(&elevatorCpus, cpu_online_mask);
+    cpumask_copy(&backgroundCpus, cpu_online_mask);
+    return 0;
+  }
+
+  if (cpulist_parse(cpu_list, &elevatorCpus) || !cpumask_intersects(&elevatorCpus, cpu_online_mask)) {
+    return -EINVAL;
+  }
+  cpumask_and(&elevatorCpus, &elevatorCpus, cpu_online_mask);
+
+  // Keep the generator and the sampler from competing with the elevator for the CPUs it was given
+  cpumask_andnot(&backgroundCpus, cpu_online_mask, &elevatorCpus);
+  if (cpumask_empty(&backgroundCpus)) {
+    cpumask_copy(&backgroundCpus, cpu_online_mask);
+  }
+
+  return 0;
+}
+
+// Apply rt_priority and cpu_list to the elevator thread before it first runs
+void placeElevatorThread(struct task_struct *thread) {
+  struct sched_param param = { .sched_priority = rt_priority };
+
+  if (rt_priority > 0 && sched_setscheduler(thread, SCHED_FIFO, &param)) {
+    printk(KERN_WARNING "Could not make the elevator thread SCHED_FIFO");
+  }
+
+  if (set_cpus_allowed_ptr(thread, &elevatorCpus)) {
+    printk(KERN_WARNING "Could not move the elevator thread to cpus %s", cpu_list);
+  }
+}
+
+// From http://tuxthink.blogspot.ca/2014/06/teminating-kernel-thread-using.html
+// (thread_init, thread_cleanup code)
+int thread_init(void) {
+    char our_thread[16]="elevator-thread";
+
+    elevator_thread = kthread_create(thread_fn, NULL, our_thread);
+    if((elevator_thread))
+    {
+      placeElevatorThread(elevator_thread);
+      profile_counters_init(elevator_thread);
+      // kthread_create needs to be returned by the task_struct passed to the wake_up_process function;
+      // this function will awaken the new kernel thread 
+      wake_up_process(elevator_thread);
+    }
+
+    return 0;
+}
+
+void thread_cleanup(void) {
+  int ret;
+  printk(KERN_INFO "cleanup...");
+  printk(KERN_INFO "thread_state: %ld", elevator_thread->state);
+  if (elevator_thread->state!= 2)
+  {
+    printk(KERN_INFO "Not stopping thread");
+  }
+  else {
+    ret = kthread_stop(elevator_thread);
+    printk("value of ret = %d", ret);
+    if(ret == 0)
+     printk(KERN_INFO "Thread stopped");
+  }
+  profile_counters_cleanup();
+}
+
+// Sleep for the duration of an action. In timer mode nothing sleeps: the time is added to the delay the state
+// machine arms its timer with once the current step is done.
+void elevatorSleep(unsigned int ms) {
+  if (timer_mode) {
+    pendingDelay += ms;
+  }
+  else {
+    msleep(ms);
+  }
+}
+
+// Queue the next state machine step: on the first CPU of cpu_list if one was given,
+// and on the high priority worker pool if rt_priority is set
+void queueElevatorStep() {
+  struct workqueue_struct *queue = rt_priority > 0 ? system_highpri_wq : system_wq;
+
+  if (cpu_list != NULL && cpu_list[0] != 0) {
+    queue_work_on(cpumask_first(&elevatorCpus), queue, &elevatorWork);
+  }
+  else {
+    queue_work(queue, &elevatorWork);
+  }
+}
+
+// Timer expiry: run the next step in process context, since actions allocate, free and print
+enum hrtimer_restart elevatorTimerFn(struct hrtimer *timer) {
+  queueElevatorStep();
+  return HRTIMER_NORESTART;
+}
+
+/* One step of the timer mode state machine.
+ * Takes one action (or one 100 ms poll while waiting or parked), then arms the timer for the time the action
+ * takes. Deadlines are absolute, so however late a step runs the elevator's timeline doesn't drift.
+ */
+void elevatorStep(struct work_struct *work) {
+  struct timeval tv;
+  int home_floor;
+
+  pendingDelay = 0;
+
+  switch (elevatorState) {
+    case STATE_WAITING:
+      if (firstOrigin < 0) {
+        pendingDelay = 100;
+        break;
+      }
+
+      printk(KERN_INFO "Start time: ");
+      getCurrentTime(tv, &timerStartSec, &timerStartUsec);
+      printk(KERN_INFO "%lu sec %lu usec\n", timerStartSec, timerStartUsec);
+      elevatorDeadline = ktime_get();
+
+      moveElevatorTo(firstOrigin);
+      elevatorState = STATE_RUNNING;
+      break;
+
+    case STATE_PARKED:
+      if (existsPassengerNode() == 0) {
+        if (idleTicks < idle_timeout * 10) {
+          idleTicks++;
+          pendingDelay = 100;
+          break;
+        }
+        if (finishElevator()) {
+          printResults(timerStartSec, timerStartUsec, timerEndSec, timerEndUsec);
+          elevatorState = STATE_DONE;
+          return;
+        }
+      }
+      elevatorState = STATE_RUNNING;
+      // fall through, there is new work
+
+    case STATE_RUNNING:
+      if (existsPassengerNode() > 0) {
+        if (!decideAction()) {
+          pendingDelay = 100;
+        }
+        break;
+      }
+
+      // Queue drained: same as waitForPassengers
+      getCurrentTime(tv, &timerEndSec, &timerEndUsec);
+      home_floor = parkingFloor();
+      if (home_floor != elevatorCar.current_floor->id) {
+        printk(KERN_INFO "Parking at floor %d", home_floor);
+        moveElevatorTo(home_floor);
+      }
+      idleTicks = 0;
+      elevatorState = STATE_PARKED;
+      break;
+
+    default:
+      return;
+  }
+
+  if (!timerStopping) {
+    elevatorDeadline = ktime_add_ms(elevatorDeadline, pendingDelay);
+    hrtimer_start(&elevatorTimer, elevatorDeadline, HRTIMER_MODE_ABS);
+  }
+}
+
+int state_machine_init(void) {
+  hrtimer_init(&elevatorTimer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+  elevatorTimer.function = elevatorTimerFn;
+  INIT_WORK(&elevatorWork, elevatorStep);
+
+  elevatorDeadline = ktime_get();
+  queueElevatorStep();
+
+  return 0;
+}
+
+void state_machine_cleanup(void) {
+  printk(KERN_INFO "cleanup...");
+  timerStopping = true;
+
+  // A step that was already running may arm the timer once more, and that timer may queue one more step
+  hrtimer_cancel(&elevatorTimer);
+  cancel_work_sync(&elevatorWork);
+  hrtimer_cancel(&elevatorTimer);
+  cancel_work_sync(&elevatorWork);
+  printk(KERN_INFO "State machine stopped");
+}
+
@@ -0,0 +1,155 @@
+#ifndef ELEVATOR_CORE_H
+#define ELEVATOR_CORE_H
+
+/* Elevator core shared by the fcfs, sdf, round_robin and adaptive modules: the device, the floor queues and the car,
+ * the floor indexes, the thread and timer execution modes, statistics, sampling, profiling and the arrival generator.
+ * Each module links it with one *_policy.c file that provides the definitions at the end of this header.
+ */
+
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/kref.h>
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+#include <linux/bitmap.h>
+#include <linux/log2.h>
+#include <linux/device.h>
+
+// Elevator macros
+#define NUM_FLOORS 6
+
+// Buildings with fewer floors only keep the leaves of the floor indexes and scan them: there the scan finds work within
+// a few floors, which costs less than keeping the ranges above the leaves up to date (measured with bench.c)
+#define INDEX_MIN_FLOORS 512
+
+// Decision profiler macros
+#define PROFILE_BUCKETS 16
+#define PROFILE_COUNTERS 3 // instructions, cache misses, branch misses
+
+// Scheduling policies, each with its own decision profile
+#define FCFS 0
+#define SDF 1
+#define ROUND_ROBIN 2
+#define NUM_POLICIES 3
+
+/* Elevator data structures */
+// One per open descriptor, so a client can wait for the passengers it wrote to be delivered
+typedef struct riderFile {
+  struct kref ref; // held by the descriptor and by each of its passengers still in the system
+  atomic_t delivered; // passengers dropped off that dev_read hasn't reported yet
+} riderFile;
+
+typedef struct passengerNode {
+  int id;
+  int destination;
+  int count; // riders in the group, who all travel together from the same origin to the same destination
+  riderFile* rider; // descriptor the passenger was written to, NULL if none
+  struct passengerNode* next;
+} passengerNode;
+
+typedef struct floorQueue {
+  int id;
+  passengerNode* startQueue;
+  passengerNode* endQueue;
+} floorQueue;
+
+// Last answer the elevator got from a floor index and what it depends on: until the car moves or one of the floors
+// low..high changes the answer stays the same, so it is reused instead of searching the index again
+typedef struct indexCache {
+  int query; // QUERY_*, or a direction
+  int from; // car floor the answer was found from
+  int low, high;
+  int answer;
+} indexCache;
+
+// Segment tree over the floors that need the elevator. Node 1 is the root, the children of node i are 2i and 2i + 1,
+// and floor f is the leaf leaves + f. Every node holds the lowest passenger id on its range of floors, or 0 if none
+// of them has work, so the nearest floor with work and the floor with the lowest id are found in O(log floors).
+typedef struct floorIndex {
+  int leaves; // smallest power of two >= NUM_FLOORS
+  int minId[2 * roundup_pow_of_two(NUM_FLOORS)]; // 2 * leaves nodes
+  DECLARE_BITMAP(dirty, NUM_FLOORS); // floors changed since the cached answer was found
+  indexCache cache;
+} floorIndex;
+
+typedef struct elevator {
+  floorQueue* current_floor;
+  int passengerCount;
+  // array of passengerNode pointers; each array element represents a queue of passengers for a given floor,
+  //with the first passenger in the queue being the one with the lowest priority id
+  passengerNode* passengerArray[NUM_FLOORS];
+} elevator;
+
+typedef struct decisionProfile {
+  unsigned long count;
+  unsigned long recomputed; // decisions that searched a floor index instead of reusing a cached answer
+  u64 totalNs;
+  u64 maxNs;
+  unsigned long buckets[PROFILE_BUCKETS]; // bucket i counts decisions under PROFILE_MIN_NS << i ns, the last one the rest
+  u64 counterTotals[PROFILE_COUNTERS]; // summed hardware counts, with profile_counters
+} decisionProfile;
+
+typedef struct decisionSample {
+  u64 start; // ns
+  u64 counts[PROFILE_COUNTERS];
+  unsigned long searches; // indexSearches when the decision started
+} decisionSample;
+
+/* Elevator global variables */
+extern floorQueue shaftArray[NUM_FLOORS];
+extern elevator elevatorCar;
+extern int firstOrigin;
+
+// Floor queues, nextId and queueCount: concurrent writers append to the queues while the elevator boards from them
+extern spinlock_t queueLock;
+
+// Floors with waiting passengers (protected by queueLock) and floors the car has passengers for (elevator only)
+extern floorIndex waitingFloors;
+extern floorIndex ridingFloors;
+
+// Decision profiles, indexed by policy. Only the elevator writes them.
+extern decisionProfile decisionProfiles[NUM_POLICIES];
+extern const char *policyNames[NUM_POLICIES];
+
+extern struct device *driverDevice;
+
+// module functions
+int elevator_init(void);
+void elevator_exit(void);
+
+// elevator function prototypes
+int moveElevatorTo(int);
+void pickUp(void);
+void dropOff(void);
+int existsPassengerNode(void);
+int elevatorFull(void);
+int waitForPassengers(unsigned long*, unsigned long*);
+int finishElevator(void);
+int startElevator(unsigned long*, unsigned long*);
+void printResults(unsigned long, unsigned long, unsigned long, unsigned long);
+
+// floor index queries
+int closestFloor(floorIndex*);
+int cachedLowest(floorIndex*); // caller must hold queueLock for waitingFloors
+int nextStop(int);
+
+// decision profiler prototypes
+void startDecision(decisionSample*);
+void endDecision(decisionSample*, decisionProfile*);
+
+// demand estimation prototypes
+unsigned long floorDemand(int);
+unsigned long pairDemand(int, int);
+
+/* Provided by the policy */
+extern const char elevatorName[]; // device name, also used under /sys/class/myclass, debugfs and in the log
+extern const char algorithmName[]; // printed when the run completes
+extern const int elevatorCapacity;
+extern const int elevatorPolicy; // profile decisions_show always prints, NUM_POLICIES if the policy can change
+
+// Target of the next move for the timer mode state machine, or -1 if there is none. Times itself into decisionProfiles.
+int nextTarget(void);
+int thread_fn(void*);
+void printPolicyResults(void); // anything the policy adds to the log of printResults
+
+#endif
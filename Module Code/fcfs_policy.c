@@ -0,0 +1,91 @@
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+
+#include "elevator_core.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Adrianna Chang & Britta Evans");
+MODULE_DESCRIPTION("Linux device to simulate first come first serve elevator system");
+
+const char elevatorName[] = "fcfs";
+const char algorithmName[] = "FIRST COME FIRST SERVE";
+const int elevatorCapacity = 8;
+const int elevatorPolicy = FCFS;
+
+/* Initialization function
+ */
+static int __init fcfs_init(void) {
+  return elevator_init();
+}
+
+static void __exit fcfs_exit(void) {
+  elevator_exit();
+}
+
+// Target of the next move: the drop off floor of the passenger in the car with the lowest id,
+// or if the car is empty, the floor of the waiting passenger with the lowest id
+int nextTarget() {
+  int next_destination;
+  decisionSample sample;
+
+  startDecision(&sample);
+  next_destination = cachedLowest(&ridingFloors);
+  if (next_destination < 0) {
+    spin_lock(&queueLock);
+    next_destination = cachedLowest(&waitingFloors);
+    spin_unlock(&queueLock);
+  }
+  endDecision(&sample, &decisionProfiles[FCFS]);
+
+  return next_destination;
+}
+
+// The run's results need nothing from this policy
+void printPolicyResults() {
+}
+
+int thread_fn(void * v) {
+  unsigned long start_sec, start_usec, end_sec, end_usec;
+  int next_destination;
+
+  if (!startElevator(&start_sec, &start_usec)) {
+    return 0;
+  }
+
+  while (existsPassengerNode() > 0 || waitForPassengers(&end_sec, &end_usec) > 0
+         || !finishElevator()) {
+    if(kthread_should_stop()) {
+      do_exit(0);
+    }
+
+    // Algorithm
+    // Check for pick up (a full car goes on to its drop offs instead)
+    if (shaftArray[elevatorCar.current_floor->id].startQueue != NULL && !elevatorFull()) {
+      pickUp();
+    }
+
+    // Determine next destination: the drop off floor of the passenger in the car with the highest priority,
+    // or if the car is empty, the floor of the waiting passenger with the highest priority
+    next_destination = nextTarget();
+
+    if (next_destination >= 0) {
+      // Move to next destination
+      moveElevatorTo(next_destination);
+
+      // Check for drop off
+      if (elevatorCar.passengerArray[elevatorCar.current_floor->id] != NULL) {
+        dropOff();
+      }
+    }
+  }
+
+  printResults(start_sec, start_usec, end_sec, end_usec);
+
+  return 0;
+}
+
+module_init(fcfs_init);
+module_exit(fcfs_exit);
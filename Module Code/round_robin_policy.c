@@ -0,0 +1,92 @@
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+
+#include "elevator_core.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Adrianna Chang & Britta Evans");
+MODULE_DESCRIPTION("Linux device to simulate round robin elevator system");
+
+const char elevatorName[] = "round_robin";
+const char algorithmName[] = "ROUND ROBIN";
+const int elevatorCapacity = 8;
+const int elevatorPolicy = ROUND_ROBIN;
+
+int elevatorDirection = 1; // 1 = up, -1 = down
+
+/* Initialization function
+ */
+static int __init round_robin_init(void) {
+  return elevator_init();
+}
+
+static void __exit round_robin_exit(void) {
+  elevator_exit();
+}
+
+// Target of the next move: next floor in the sweep direction where someone is waiting or getting off
+int nextTarget() {
+  int next_floor;
+  decisionSample sample;
+
+  startDecision(&sample);
+  if (elevatorCar.current_floor->id == 0) {
+    elevatorDirection = 1;
+  }
+  else if (elevatorCar.current_floor->id == NUM_FLOORS - 1) {
+    elevatorDirection = -1;
+  }
+
+  next_floor = nextStop(elevatorDirection);
+  endDecision(&sample, &decisionProfiles[ROUND_ROBIN]);
+
+  return next_floor;
+}
+
+// The run's results need nothing from this policy
+void printPolicyResults() {
+}
+
+int thread_fn(void * v) {
+  unsigned long start_sec, start_usec, end_sec, end_usec;
+  int next_floor;
+
+  if (!startElevator(&start_sec, &start_usec)) {
+    return 0;
+  }
+
+  while(existsPassengerNode() > 0 || waitForPassengers(&end_sec, &end_usec) > 0
+         || !finishElevator()) {
+    if(kthread_should_stop()) {
+      do_exit(0);
+    }
+
+    // Algorithm
+    // Check for pick up (a full car goes on to its drop offs instead)
+    if (shaftArray[elevatorCar.current_floor->id].startQueue != NULL && !elevatorFull()) {
+      pickUp();
+    }
+
+    // Check for direction changes, then find the next floor in this direction that needs a stop
+    next_floor = nextTarget();
+
+    // Move elevator nonstop to it
+    moveElevatorTo(next_floor);
+
+
+    // Check for drop off
+    if (elevatorCar.passengerArray[elevatorCar.current_floor->id] != NULL) {
+      dropOff();
+    }
+  }
+
+  printResults(start_sec, start_usec, end_sec, end_usec);
+
+  return 0;
+}
+
+module_init(round_robin_init);
+module_exit(round_robin_exit);
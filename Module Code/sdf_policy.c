@@ -0,0 +1,103 @@
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+
+#include "elevator_core.h"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Adrianna Chang & Britta Evans");
+MODULE_DESCRIPTION("Linux device to simulate shortest distance first elevator system");
+
+const char elevatorName[] = "sdf";
+const char algorithmName[] = "SHORTEST DISTANCE FIRST";
+const int elevatorCapacity = 16;
+const int elevatorPolicy = SDF;
+
+/* Initialization function
+ */
+static int __init sdf_init(void) {
+  return elevator_init();
+}
+
+static void __exit sdf_exit(void) {
+  elevator_exit();
+}
+
+// Target of the next move: closest floor with a waiting passenger if the car is empty, otherwise closest drop off floor
+int nextTarget() {
+  int target;
+  decisionSample sample;
+
+  startDecision(&sample);
+  if (elevatorCar.passengerCount == 0) {
+    target = closestFloor(&waitingFloors);
+  }
+  else {
+    target = closestFloor(&ridingFloors);
+  }
+  endDecision(&sample, &decisionProfiles[SDF]);
+
+  return target;
+}
+
+// The run's results need nothing from this policy
+void printPolicyResults() {
+}
+
+int thread_fn(void * v) {
+  unsigned long start_sec, start_usec, end_sec, end_usec;
+  int target;
+  decisionSample sample;
+
+  if (!startElevator(&start_sec, &start_usec)) {
+    return 0;
+  }
+
+  while(existsPassengerNode() > 0 || waitForPassengers(&end_sec, &end_usec) > 0
+         || !finishElevator()) {
+    if(kthread_should_stop()) {
+      do_exit(0);
+    }
+    // Algorithm
+    // Check for pick up (a full car goes on to its drop offs instead)
+    if (shaftArray[elevatorCar.current_floor->id].startQueue != NULL && !elevatorFull()) {
+      pickUp();
+    }
+
+    // Check if anyone in elevator
+    // If no, then we need to check floors
+    if (elevatorCar.passengerCount == 0) {
+      // Check for closest floor with passenger to move to
+      startDecision(&sample);
+      target = closestFloor(&waitingFloors);
+      endDecision(&sample, &decisionProfiles[SDF]);
+      if (target >= 0) {
+        moveElevatorTo(target);
+      }
+      pickUp();
+    }
+
+    //Finding closest floor for drop off
+    // Same logic as above, but checking the elevatorCar rather than the floors
+    // In order to determine drop off
+    startDecision(&sample);
+    target = closestFloor(&ridingFloors);
+    endDecision(&sample, &decisionProfiles[SDF]);
+    if (target >= 0) {
+      moveElevatorTo(target);
+    }
+    // Check for drop off
+    if (elevatorCar.passengerArray[elevatorCar.current_floor->id] != NULL) {
+      dropOff();
+    }
+  }
+
+  printResults(start_sec, start_usec, end_sec, end_usec);
+
+  return 0;
+}
+
+module_init(sdf_init);
+module_exit(sdf_exit);
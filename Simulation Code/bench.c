@@ -0,0 +1,384 @@
+/* Microbenchmarks of the elevator's hot functions.
+ * Times the simulator's ports of addPassengertoQueue, enterElevator, pickUp, dropOff and nextTarget, where the
+ * modules' msleep is already replaced by the virtual clock, and whole simulated runs, for every combination of floor
+ * count and queue depth. Each measurement is repeated after a number of untimed warmup runs and reported
+ * as min, median, mean and standard deviation of ns per operation, with the heap allocations per operation.
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc at link time (see the build line in ReadMe.txt),
+ * so only allocations made inside a timed section are counted. Passengers come from a fixed seed, so two builds
+ * benchmark exactly the same operations and their numbers can be compared directly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include "elevator_sim.h"
+
+#define MAX_VALUES 64 // floor counts and depths per run
+#define LOOKUPS 65536 // nextTarget calls per run
+
+typedef struct benchCase {
+  const char* name;
+  const char* unit; // what one operation is
+  // Set up a building with the given floors and queue depth, run the timed section once, return the operations it did
+  long (*run)(int, int);
+} benchCase;
+
+/* Allocation counting */
+void* __real_malloc(size_t);
+void* __real_calloc(size_t, size_t);
+void* __real_realloc(void*, size_t);
+
+static long allocations = 0;
+
+void* __wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+  allocations++;
+  return __real_realloc(p, size);
+}
+
+/* Timed section, one per run */
+static struct timespec timerStart;
+static long allocationsAtStart;
+static double timedNs;
+static double timerOverhead = 0; // ns an empty timed section takes, subtracted from every measurement
+static long timedAllocations;
+static volatile long sink; // keeps lookups from being optimized away
+
+static void startTimer(void) {
+  allocationsAtStart = allocations;
+  clock_gettime(CLOCK_MONOTONIC, &timerStart);
+}
+
+static void stopTimer(void) {
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  timedNs = (end.tv_sec - timerStart.tv_sec) * 1e9 + (end.tv_nsec - timerStart.tv_nsec) - timerOverhead;
+  if (timedNs < 0) {
+    timedNs = 0;
+  }
+  timedAllocations = allocations - allocationsAtStart;
+}
+
+/* Setup helpers, untimed */
+static trace noArrivals = { NULL, 0 }; // advanceClock admits arrivals from the trace, there are none here
+static unsigned long long randomState;
+
+static unsigned long long nextRandom(void) {
+  unsigned long long z = (randomState += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static void setUp(simulation* sim, int floors, int capacity) {
+  if (initializeSimulation(sim, floors, capacity, SDF) < 0) {
+    fprintf(stderr, "bench: out of memory\n");
+    exit(1);
+  }
+  sim->input = &noArrivals;
+  randomState = 42;
+}
+
+// Queue count passengers at origin (or at random floors if origin < 0) going to random other floors
+static void queuePassengers(simulation* sim, int count, int origin) {
+  int i, from, to;
+
+  for (i=0; i<count; i++) {
+    from = origin >= 0 ? origin : (int)(nextRandom() % sim->numFloors);
+    to = (from + 1 + (int)(nextRandom() % (sim->numFloors - 1))) % sim->numFloors;
+    if (addPassengertoQueue(sim, from, to) < 0) {
+      fprintf(stderr, "bench: out of memory\n");
+      exit(1);
+    }
+  }
+}
+
+/* Benchmarks */
+static long benchAdd(int floors, int depth) {
+  simulation sim;
+  int* origins = malloc(depth * sizeof(int));
+  int* destinations = malloc(depth * sizeof(int));
+  int i;
+
+  setUp(&sim, floors, ELEVATOR_CAPACITY);
+  for (i=0; i<depth; i++) {
+    origins[i] = nextRandom() % floors;
+    destinations[i] = (origins[i] + 1 + nextRandom() % (floors - 1)) % floors;
+  }
+
+  startTimer();
+  for (i=0; i<depth; i++) {
+    addPassengertoQueue(&sim, origins[i], destinations[i]);
+  }
+  stopTimer();
+
+  freeSimulation(&sim);
+  free(origins);
+  free(destinations);
+  return depth;
+}
+
+static long benchEnter(int floors, int depth) {
+  simulation sim;
+  int i;
+
+  setUp(&sim, floors, depth);
+  queuePassengers(&sim, depth, 0);
+
+  startTimer();
+  for (i=0; i<depth; i++) {
+    enterElevator(&sim, sim.elevatorCar.current_floor->startQueue);
+  }
+  stopTimer();
+
+  freeSimulation(&sim);
+  return depth;
+}
+
+static long benchPickUp(int floors, int depth) {
+  simulation sim;
+
+  setUp(&sim, floors, depth);
+  queuePassengers(&sim, depth, 0);
+
+  startTimer();
+  pickUp(&sim);
+  stopTimer();
+
+  freeSimulation(&sim);
+  return depth;
+}
+
+static long benchDropOff(int floors, int depth) {
+  simulation sim;
+  int i;
+
+  setUp(&sim, floors, depth);
+  for (i=0; i<depth; i++) {
+    addPassengertoQueue(&sim, 0, floors - 1);
+  }
+  pickUp(&sim);
+  moveElevatorTo(&sim, floors - 1);
+
+  startTimer();
+  dropOff(&sim);
+  stopTimer();
+
+  freeSimulation(&sim);
+  return depth;
+}
+
+// SDF decisions for an empty car, from a different floor every time so no cached answer applies
+static long benchNextTarget(int floors, int depth) {
+  simulation sim;
+  long sum = 0;
+  int i;
+
+  setUp(&sim, floors, ELEVATOR_CAPACITY);
+  queuePassengers(&sim, depth, -1);
+
+  startTimer();
+  for (i=0; i<LOOKUPS; i++) {
+    sim.elevatorCar.current_floor = &sim.shaftArray[i % floors];
+    sum += nextTarget(&sim);
+  }
+  stopTimer();
+
+  sink = sum;
+  freeSimulation(&sim);
+  return LOOKUPS;
+}
+
+// A whole SDF run of depth passengers arriving at 30 per minute, where cached answers are reused between events
+static long benchSimulation(int floors, int depth) {
+  simulation sim;
+  trace input;
+
+  setUp(&sim, floors, ELEVATOR_CAPACITY);
+  if (generateTrace(&input, floors, 30, depth, randomState) < 0) {
+    fprintf(stderr, "bench: out of memory\n");
+    exit(1);
+  }
+
+  startTimer();
+  runSimulation(&sim, &input);
+  stopTimer();
+
+  freeSimulation(&sim);
+  freeTrace(&input);
+  return depth;
+}
+
+static const benchCase benchCases[] = {
+  { "addPassengertoQueue", "passenger", benchAdd },
+  { "enterElevator", "passenger", benchEnter },
+  { "pickUp", "passenger boarded", benchPickUp },
+  { "dropOff", "passenger dropped off", benchDropOff },
+  { "nextTarget", "call", benchNextTarget },
+  { "runSimulation", "passenger", benchSimulation },
+};
+#define NUM_CASES ((int)(sizeof(benchCases) / sizeof(benchCases[0])))
+
+static int compareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+// Median cost of an empty timed section, so single operations at depth 1 aren't mostly clock_gettime
+static void calibrateTimer(void) {
+  double empty[101];
+  int i;
+
+  for (i=0; i<101; i++) {
+    startTimer();
+    stopTimer();
+    empty[i] = timedNs;
+  }
+  qsort(empty, 101, sizeof(double), compareDoubles);
+  timerOverhead = empty[50];
+}
+
+static int parseList(const char* text, int* values) {
+  int count = 0;
+  int lo, hi, step, value;
+  char* copy = strdup(text), *item, *save;
+
+  for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    if (sscanf(item, "%d:%d:%d", &lo, &hi, &step) == 3) {
+      if (step <= 0) {
+        count = -1;
+        break;
+      }
+      for (value = lo; value <= hi && count < MAX_VALUES; value += step) {
+        values[count++] = value;
+      }
+    }
+    else if (sscanf(item, "%d", &value) == 1 && count < MAX_VALUES) {
+      values[count++] = value;
+    }
+    else {
+      count = -1;
+      break;
+    }
+  }
+
+  free(copy);
+  return count;
+}
+
+static void usage(const char* name) {
+  int i;
+
+  fprintf(stderr, "usage: %s [-b benchmark] [-f floors] [-d depths] [-r repetitions] [-w warmup]\n", name);
+  fprintf(stderr, "  floors, depths: comma separated values or lo:hi:step ranges (default 6 and 1,16,256,4096)\n");
+  fprintf(stderr, "  benchmarks:");
+  for (i=0; i<NUM_CASES; i++) {
+    fprintf(stderr, " %s", benchCases[i].name);
+  }
+  fprintf(stderr, " (default all)\n");
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  int opt, c, f, d, r;
+  int floorValues[MAX_VALUES] = { NUM_FLOORS }, depthValues[MAX_VALUES] = { 1, 16, 256, 4096 };
+  int numFloorValues = 1, numDepthValues = 4;
+  int repetitions = 21, warmup = 5;
+  const char* only = NULL;
+  double* samples;
+  double mean, variance;
+  long ops, total_allocations;
+
+  while ((opt = getopt(argc, argv, "b:f:d:r:w:")) != -1) {
+    switch (opt) {
+      case 'b':
+        only = optarg;
+        break;
+      case 'f':
+        numFloorValues = parseList(optarg, floorValues);
+        break;
+      case 'd':
+        numDepthValues = parseList(optarg, depthValues);
+        break;
+      case 'r':
+        repetitions = atoi(optarg);
+        break;
+      case 'w':
+        warmup = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || numFloorValues <= 0 || numDepthValues <= 0 || repetitions < 1 || warmup < 0) {
+    usage(argv[0]);
+  }
+  for (f=0; f<numFloorValues; f++) {
+    if (floorValues[f] < 2) {
+      fprintf(stderr, "bench: buildings need at least 2 floors\n");
+      return 1;
+    }
+  }
+  for (d=0; d<numDepthValues; d++) {
+    if (depthValues[d] < 1) {
+      fprintf(stderr, "bench: depths must be at least 1\n");
+      return 1;
+    }
+  }
+
+  samples = malloc(repetitions * sizeof(double));
+  calibrateTimer();
+  printf("# %d warmup runs, %d timed runs each, %.1f ns timer overhead subtracted\n", warmup, repetitions, timerOverhead);
+  printf("%-24s %7s %7s %10s %10s %10s %10s %10s  %s\n", "benchmark", "floors", "depth", "min_ns", "median_ns",
+         "mean_ns", "stddev_ns", "allocs", "per");
+
+  for (c=0; c<NUM_CASES; c++) {
+    if (only != NULL && strcmp(only, benchCases[c].name) != 0) {
+      continue;
+    }
+    for (f=0; f<numFloorValues; f++) {
+      for (d=0; d<numDepthValues; d++) {
+        for (r=0; r<warmup; r++) {
+          benchCases[c].run(floorValues[f], depthValues[d]);
+        }
+
+        mean = 0;
+        total_allocations = 0;
+        for (r=0; r<repetitions; r++) {
+          ops = benchCases[c].run(floorValues[f], depthValues[d]);
+          samples[r] = timedNs / ops;
+          mean += samples[r];
+          total_allocations += timedAllocations;
+        }
+        mean /= repetitions;
+        variance = 0;
+        for (r=0; r<repetitions; r++) {
+          variance += (samples[r] - mean) * (samples[r] - mean);
+        }
+        qsort(samples, repetitions, sizeof(double), compareDoubles);
+
+        printf("%-24s %7d %7d %10.2f %10.2f %10.2f %10.2f %10.4f  %s\n", benchCases[c].name, floorValues[f],
+               depthValues[d], samples[0], samples[repetitions / 2], mean, sqrt(variance / repetitions),
+               (double)total_allocations / repetitions / ops, benchCases[c].unit);
+      }
+    }
+  }
+
+  free(samples);
+  return 0;
+}
@@ -0,0 +1,1089 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "elevator_sim.h"
+
+// demandDecay[k] = 65536 * (31/32)^(2^k), same table as the modules
+static const unsigned int demandDecay[] = { 63488, 61504, 57720, 50836, 39434, 23728, 8591, 1126, 19 };
+
+static const char* policyNames[NUM_POLICIES] = { "fcfs", "sdf", "round_robin" };
+static const int policyCapacities[NUM_POLICIES] = { ELEVATOR_CAPACITY, SDF_CAPACITY, ELEVATOR_CAPACITY };
+
+/* Integer square root, rounded down like the kernel's int_sqrt()
+ */
+static unsigned long int_sqrt(unsigned long x) {
+  unsigned long b, m, y = 0;
+
+  if (x <= 1) {
+    return x;
+  }
+
+  m = 1UL << (sizeof(x) * 8 - 2);
+  while (m > x) {
+    m >>= 2;
+  }
+
+  while (m != 0) {
+    b = y + m;
+    y >>= 1;
+    if (x >= b) {
+      x -= b;
+      y += m;
+    }
+    m >>= 2;
+  }
+
+  return y;
+}
+
+/* Load a trace file: one request per line, "<ms since start> <origin> <destination>".
+ * Blank lines and lines starting with # are ignored. Returns 0 on success, -1 on error.
+ */
+int loadTrace(const char* path, trace* out) {
+  FILE* fp;
+  char line[256];
+  int line_num = 0, size = 0, i;
+  tripRequest request;
+
+  out->requests = NULL;
+  out->count = 0;
+
+  if ((fp = fopen(path, "r")) == NULL) {
+    perror(path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    line_num++;
+    if (line[0] == '#' || line[0] == '\n') {
+      continue;
+    }
+    if (sscanf(line, "%ld %d %d", &request.time, &request.origin, &request.destination) != 3) {
+      fprintf(stderr, "%s:%d: expected \"<ms> <origin> <destination>\"\n", path, line_num);
+      fclose(fp);
+      freeTrace(out);
+      return -1;
+    }
+
+    if (out->count == size) {
+      size = size ? size * 2 : 64;
+      out->requests = realloc(out->requests, size * sizeof(tripRequest));
+      if (out->requests == NULL) {
+        perror("realloc");
+        fclose(fp);
+        return -1;
+      }
+    }
+
+    // Insertion sort: recorded traces are already in order, so this is linear for them
+    i = out->count++;
+    while (i > 0 && out->requests[i - 1].time > request.time) {
+      out->requests[i] = out->requests[i - 1];
+      i--;
+    }
+    out->requests[i] = request;
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+void freeTrace(trace* t) {
+  free(t->requests);
+  t->requests = NULL;
+  t->count = 0;
+}
+
+// splitmix64, so generated traces only depend on the seed and not on the C library or on other threads
+static unsigned long long nextRandom(unsigned long long* state) {
+  unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static int randomFloor(unsigned long long* state, int lo, int hi) {
+  return lo + (int)(nextRandom(state) % (unsigned long long)(hi - lo + 1));
+}
+
+/* Generate a trace with the same passenger mix as test_code.c: half the passengers travel between two random
+ * upper floors, a quarter start at the ground floor and a quarter end there. Arrivals are a Poisson process with
+ * rate passengers per minute. The same seed always gives the same trace.
+ * Returns 0 on success, -1 on bad arguments or if out of memory.
+ */
+int generateTrace(trace* out, int num_floors, double rate, int count, unsigned long long seed) {
+  int i, kind;
+  double u, time = 0;
+  tripRequest* request;
+
+  out->count = 0;
+  out->requests = NULL;
+  if (num_floors < 2 || rate <= 0 || count < 0) {
+    return -1;
+  }
+  if ((out->requests = malloc((count ? count : 1) * sizeof(tripRequest))) == NULL) {
+    return -1;
+  }
+
+  for (i=0; i<count; i++) {
+    request = &out->requests[i];
+    request->time = (long)time;
+
+    kind = nextRandom(&seed) % 4;
+    // A two floor building has no pair of distinct upper floors
+    if (kind < 2 && num_floors > 2) {
+      request->origin = randomFloor(&seed, 1, num_floors - 1);
+      do {
+        request->destination = randomFloor(&seed, 1, num_floors - 1);
+      } while (request->destination == request->origin);
+    }
+    else if (kind == 2) {
+      request->origin = 0;
+      request->destination = randomFloor(&seed, 1, num_floors - 1);
+    }
+    else {
+      request->origin = randomFloor(&seed, 1, num_floors - 1);
+      request->destination = 0;
+    }
+
+    // Exponential inter-arrival time, u in (0, 1]
+    u = (double)((nextRandom(&seed) >> 11) + 1) / 9007199254740992.0;
+    time += -log(u) * 60000.0 / rate;
+  }
+
+  out->count = count;
+  return 0;
+}
+
+const char* policyName(int policy) {
+  if (policy < 0 || policy >= NUM_POLICIES) {
+    return "unknown";
+  }
+  return policyNames[policy];
+}
+
+// Capacity of the car in the module that runs the policy
+int policyCapacity(int policy) {
+  if (policy < 0 || policy >= NUM_POLICIES) {
+    return ELEVATOR_CAPACITY;
+  }
+  return policyCapacities[policy];
+}
+
+int policyFromName(const char* name) {
+  int i;
+
+  for (i=0; i<NUM_POLICIES; i++) {
+    if (strcmp(name, policyNames[i]) == 0) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+int initializeSimulation(simulation* sim, int num_floors, int capacity, int policy) {
+  int i;
+
+  memset(sim, 0, sizeof(*sim));
+  if (num_floors < 1 || capacity < 1 || policy < 0 || policy >= NUM_POLICIES) {
+    return -1;
+  }
+
+  sim->numFloors = num_floors;
+  sim->capacity = capacity;
+  sim->policy = policy;
+  sim->parkFloor = -1;
+  sim->nextId = 1;
+  sim->elevatorDirection = 1;
+
+  initializePool(&sim->pool);
+  sim->shaftArray = calloc(num_floors, sizeof(floorQueue));
+  sim->elevatorCar.passengerArray = malloc(num_floors * sizeof(passengerIndex));
+  sim->floorDemandArray = calloc(num_floors, sizeof(demandRate));
+  if (sim->shaftArray == NULL || sim->elevatorCar.passengerArray == NULL || sim->floorDemandArray == NULL
+      || initializeFloorIndex(&sim->waitingFloors, num_floors) < 0
+      || initializeFloorIndex(&sim->ridingFloors, num_floors) < 0) {
+    freeSimulation(sim);
+    return -1;
+  }
+
+  for (i=0; i<num_floors; i++) {
+    sim->shaftArray[i].id = i;
+    sim->shaftArray[i].startQueue = sim->shaftArray[i].endQueue = NO_PASSENGER;
+    sim->elevatorCar.passengerArray[i] = NO_PASSENGER;
+  }
+  sim->elevatorCar.current_floor = &sim->shaftArray[0];
+
+  return 0;
+}
+
+void initializePool(passengerPool* pool) {
+  pool->chunks = NULL;
+  pool->numChunks = 0;
+  pool->size = 0;
+  pool->freeList = NO_PASSENGER;
+  pool->live = 0;
+}
+
+void freePool(passengerPool* pool) {
+  uint32_t i;
+
+  for (i=0; i<pool->numChunks; i++) {
+    free(pool->chunks[i]);
+  }
+  free(pool->chunks);
+  initializePool(pool);
+}
+
+/* Take a slot from the free list, or the next fresh slot, adding a chunk when the last one is full.
+ * Returns NO_PASSENGER if out of memory.
+ */
+passengerIndex allocatePassenger(passengerPool* pool) {
+  passengerIndex p;
+  passengerChunk** chunks;
+
+  if (pool->freeList != NO_PASSENGER) {
+    p = pool->freeList;
+    pool->freeList = POOL_FIELD(pool, next, p);
+  }
+  else {
+    if (pool->size == (uint64_t)pool->numChunks * POOL_CHUNK) {
+      if (pool->size >= NO_PASSENGER - POOL_CHUNK) {
+        return NO_PASSENGER;
+      }
+      if ((chunks = realloc(pool->chunks, (pool->numChunks + 1) * sizeof(passengerChunk*))) == NULL) {
+        return NO_PASSENGER;
+      }
+      pool->chunks = chunks;
+      if ((pool->chunks[pool->numChunks] = malloc(sizeof(passengerChunk))) == NULL) {
+        return NO_PASSENGER;
+      }
+      pool->numChunks++;
+    }
+    p = pool->size++;
+  }
+
+  POOL_FIELD(pool, next, p) = NO_PASSENGER;
+  pool->live++;
+  return p;
+}
+
+void releasePassenger(passengerPool* pool, passengerIndex p) {
+  POOL_FIELD(pool, next, p) = pool->freeList;
+  pool->freeList = p;
+  pool->live--;
+}
+
+void freeSimulation(simulation* sim) {
+  freePool(&sim->pool);
+  free(sim->shaftArray);
+  free(sim->elevatorCar.passengerArray);
+  free(sim->floorDemandArray);
+  freeFloorIndex(&sim->waitingFloors);
+  freeFloorIndex(&sim->ridingFloors);
+  free(sim->floorLevels);
+  free(sim->records);
+  free(sim->events);
+  memset(sim, 0, sizeof(*sim));
+}
+
+/* Same model as the modules: accelerate, cruise at MAX_SPEED, decelerate into the stop.
+ */
+unsigned int travelTime(int floor_delta) {
+  unsigned long distance, ramp_distance, peak_speed;
+
+  if (floor_delta < 0) {
+    floor_delta *= -1;
+  }
+  if (floor_delta == 0) {
+    return 0;
+  }
+
+  distance = (unsigned long)floor_delta * FLOOR_HEIGHT;
+  ramp_distance = (unsigned long)MAX_SPEED * MAX_SPEED / (2 * ACCELERATION)
+                + (unsigned long)MAX_SPEED * MAX_SPEED / (2 * DECELERATION);
+
+  if (distance >= ramp_distance) {
+    return 1000UL * MAX_SPEED / ACCELERATION + 1000UL * MAX_SPEED / DECELERATION
+         + 1000UL * (distance - ramp_distance) / MAX_SPEED;
+  }
+
+  // Same as the modules: the product overflows a 32-bit unsigned long even for one floor, the quotient never does
+  peak_speed = int_sqrt((unsigned long)(2ULL * distance * ACCELERATION * DECELERATION / (ACCELERATION + DECELERATION)));
+  return 1000UL * peak_speed / ACCELERATION + 1000UL * peak_speed / DECELERATION;
+}
+
+// Append an event to the log if it's on; logging stops (logEvents = -1) if the log can't grow
+static void logEvent(simulation* sim, long time, long duration, int type, int floor, int value) {
+  simEvent* events;
+  simEvent* event;
+
+  if (sim->logEvents <= 0) {
+    return;
+  }
+
+  if (sim->numEvents == sim->maxEvents) {
+    events = realloc(sim->events, (sim->maxEvents ? 2 * sim->maxEvents : 1024) * sizeof(simEvent));
+    if (events == NULL) {
+      sim->logEvents = -1;
+      return;
+    }
+    sim->events = events;
+    sim->maxEvents = sim->maxEvents ? 2 * sim->maxEvents : 1024;
+  }
+
+  event = &sim->events[sim->numEvents++];
+  event->time = time;
+  event->duration = duration;
+  event->type = type;
+  event->floor = floor;
+  event->value = value;
+}
+
+static int floorQueueLength(simulation* sim, int floor_num) {
+  int length = 0;
+  passengerIndex p;
+
+  for (p = sim->shaftArray[floor_num].startQueue; p != NO_PASSENGER; p = POOL_FIELD(&sim->pool, next, p)) {
+    length++;
+  }
+
+  return length;
+}
+
+// The simulation's dev_write: queue every request whose time has come
+static void admitArrivals(simulation* sim) {
+  const tripRequest* request;
+
+  while (sim->nextRequest < sim->input->count && sim->input->requests[sim->nextRequest].time <= sim->clock) {
+    request = &sim->input->requests[sim->nextRequest++];
+    if (addPassengertoQueue(sim, request->origin, request->destination) == 0) {
+      // In the module the write lands while the elevator sleeps, so the passenger has been waiting since request->time
+      POOL_FIELD(&sim->pool, arrival, sim->shaftArray[request->origin].endQueue) = request->time;
+      updateDemand(sim, request->origin);
+      sim->queueCount++;
+      if (sim->logEvents > 0) {
+        logEvent(sim, request->time, 0, EVENT_QUEUE, request->origin, floorQueueLength(sim, request->origin));
+      }
+    }
+  }
+}
+
+/* Write a sample line for every sample time before until: "<ms since the first request> <car floor> <car load>
+ * <waiting on floor 0> ... <waiting on the last floor>". Requests that arrived by the sample time but haven't been
+ * admitted yet, because the elevator is in the middle of an action, count as waiting, like they would in the module.
+ */
+static void takeSamples(simulation* sim, long until) {
+  int i, j, depth, floor;
+  const tripRequest* request;
+
+  while (sim->nextSample < until) {
+    // A car on its way is placed between the floors it left and is heading to, like the modules' sampler does
+    floor = sim->elevatorCar.current_floor->id;
+    if (sim->nextSample < sim->legEnd) {
+      floor = sim->legFrom + (long long)(floor - sim->legFrom) * (sim->nextSample - sim->legStart)
+                             / (sim->legEnd - sim->legStart);
+    }
+    fprintf(sim->sampleFile, "%ld %d %d", sim->nextSample - sim->startTime, floor, sim->elevatorCar.passengerCount);
+    for (i=0; i<sim->numFloors; i++) {
+      depth = floorQueueLength(sim, i);
+      for (j = sim->nextRequest; j < sim->input->count && sim->input->requests[j].time <= sim->nextSample; j++) {
+        request = &sim->input->requests[j];
+        if (request->origin == i && request->destination >= 0 && request->destination < sim->numFloors) {
+          depth++;
+        }
+      }
+      fprintf(sim->sampleFile, " %d", depth);
+    }
+    fputc('\n', sim->sampleFile);
+    sim->nextSample += sim->sampleInterval;
+  }
+}
+
+// The simulation's msleep: requests that arrive while the elevator is busy are queued as time passes
+static void advanceClock(simulation* sim, long ms) {
+  if (sim->sampleFile != NULL) {
+    takeSamples(sim, sim->clock + ms);
+  }
+  sim->clock += ms;
+  admitArrivals(sim);
+}
+
+int addPassengertoQueue(simulation* sim, int origin, int destination) {
+  passengerIndex new_passenger;
+
+  if (origin < 0 || origin > sim->numFloors - 1 || destination < 0 || destination > sim->numFloors - 1) {
+    return -1;
+  }
+
+  if ((new_passenger = allocatePassenger(&sim->pool)) == NO_PASSENGER) {
+    return -1;
+  }
+
+  POOL_FIELD(&sim->pool, id, new_passenger) = sim->nextId++;
+  POOL_FIELD(&sim->pool, origin, new_passenger) = origin;
+  POOL_FIELD(&sim->pool, destination, new_passenger) = destination;
+  POOL_FIELD(&sim->pool, arrival, new_passenger) = sim->clock;
+
+  if (sim->shaftArray[origin].startQueue == NO_PASSENGER) {
+    sim->shaftArray[origin].startQueue = new_passenger;
+    indexSet(&sim->waitingFloors, origin, POOL_FIELD(&sim->pool, id, new_passenger));
+  }
+  else {
+    POOL_FIELD(&sim->pool, next, sim->shaftArray[origin].endQueue) = new_passenger;
+  }
+
+  sim->shaftArray[origin].endQueue = new_passenger;
+
+  return 0;
+}
+
+// Building floor a floor of the car is on, see setFloorLevels
+static int floorLevel(simulation* sim, int floor_num) {
+  return sim->floorLevels != NULL ? sim->floorLevels[floor_num] : floor_num;
+}
+
+int moveElevatorTo(simulation* sim, int destination_floor) {
+  int floor_delta;
+
+  if (destination_floor < 0 || destination_floor > sim->numFloors - 1) {
+    return -1;
+  }
+
+  if (destination_floor == sim->elevatorCar.current_floor->id) {
+    return 0;
+  }
+  floor_delta = floorLevel(sim, destination_floor) - floorLevel(sim, sim->elevatorCar.current_floor->id);
+
+  logEvent(sim, sim->clock, travelTime(floor_delta), EVENT_MOVE, sim->elevatorCar.current_floor->id, destination_floor);
+  sim->legFrom = sim->elevatorCar.current_floor->id;
+  sim->legStart = sim->clock;
+  sim->legEnd = sim->clock + travelTime(floor_delta);
+  sim->elevatorCar.current_floor = &sim->shaftArray[destination_floor];
+  sim->floorsTraveled += floor_delta < 0 ? -floor_delta : floor_delta;
+  advanceClock(sim, travelTime(floor_delta));
+
+  return 0;
+}
+
+void pickUp(simulation* sim) {
+  int i;
+  int delta = sim->capacity - sim->elevatorCar.passengerCount;
+
+  passengerIndex current_passenger, next_passenger;
+  current_passenger = sim->elevatorCar.current_floor->startQueue;
+
+  // Nobody can board a full car, so don't stop and open the doors for nothing
+  if (delta <= 0 || current_passenger == NO_PASSENGER) {
+    return;
+  }
+
+  for (i=0; i<delta; i++) {
+    next_passenger = POOL_FIELD(&sim->pool, next, current_passenger);
+    enterElevator(sim, current_passenger);
+    sim->elevatorCar.passengerCount++;
+    if (sim->records != NULL) {
+      sim->records[POOL_FIELD(&sim->pool, id, current_passenger) - 1].board = sim->clock;
+    }
+    sim->queueCount--;
+
+    current_passenger = next_passenger;
+    if (current_passenger == NO_PASSENGER) {
+      break;
+    }
+  }
+
+  if (sim->logEvents > 0) {
+    logEvent(sim, sim->clock, STOP_TIME, EVENT_PICKUP, sim->elevatorCar.current_floor->id, i < delta ? i + 1 : delta);
+    logEvent(sim, sim->clock, 0, EVENT_QUEUE, sim->elevatorCar.current_floor->id,
+             floorQueueLength(sim, sim->elevatorCar.current_floor->id));
+  }
+  sim->stops++;
+  advanceClock(sim, STOP_TIME);
+}
+
+void dropOff(simulation* sim) {
+  int current_floor = sim->elevatorCar.current_floor->id;
+  passengerIndex head = sim->elevatorCar.passengerArray[current_floor];
+  passengerIndex next_node;
+  passengerRecord* record;
+  int dropped = 0;
+
+  while (head != NO_PASSENGER) {
+    dropped++;
+    sim->elevatorCar.passengerCount--;
+    if (sim->records != NULL) {
+      record = &sim->records[POOL_FIELD(&sim->pool, id, head) - 1];
+      record->arrival = POOL_FIELD(&sim->pool, arrival, head);
+      record->alight = sim->clock;
+      record->origin = POOL_FIELD(&sim->pool, origin, head);
+      record->destination = POOL_FIELD(&sim->pool, destination, head);
+    }
+    next_node = POOL_FIELD(&sim->pool, next, head);
+    releasePassenger(&sim->pool, head);
+    head = next_node;
+  }
+  sim->elevatorCar.passengerArray[current_floor] = NO_PASSENGER;
+  indexSet(&sim->ridingFloors, current_floor, 0);
+
+  logEvent(sim, sim->clock, STOP_TIME, EVENT_DROPOFF, current_floor, dropped);
+  sim->stops++;
+  advanceClock(sim, STOP_TIME);
+}
+
+void enterElevator(simulation* sim, passengerIndex entering_passenger) {
+  passengerPool* pool = &sim->pool;
+  int dest = POOL_FIELD(pool, destination, entering_passenger);
+  passengerIndex* passengerArray = sim->elevatorCar.passengerArray;
+
+  sim->elevatorCar.current_floor->startQueue = POOL_FIELD(pool, next, entering_passenger);
+
+  if (passengerArray[dest] == NO_PASSENGER) {
+    passengerArray[dest] = entering_passenger;
+    POOL_FIELD(pool, next, entering_passenger) = NO_PASSENGER;
+  }
+  else {
+    if (POOL_FIELD(pool, id, passengerArray[dest]) > POOL_FIELD(pool, id, entering_passenger)) {
+      POOL_FIELD(pool, next, entering_passenger) = passengerArray[dest];
+      passengerArray[dest] = entering_passenger;
+    }
+    else {
+      POOL_FIELD(pool, next, entering_passenger) = POOL_FIELD(pool, next, passengerArray[dest]);
+      POOL_FIELD(pool, next, passengerArray[dest]) = entering_passenger;
+    }
+  }
+  indexSet(&sim->ridingFloors, dest, POOL_FIELD(pool, id, passengerArray[dest]));
+
+  if (sim->elevatorCar.current_floor->startQueue == NO_PASSENGER) {
+    sim->elevatorCar.current_floor->endQueue = NO_PASSENGER;
+    indexSet(&sim->waitingFloors, sim->elevatorCar.current_floor->id, 0);
+  }
+  else {
+    indexSet(&sim->waitingFloors, sim->elevatorCar.current_floor->id,
+             POOL_FIELD(pool, id, sim->elevatorCar.current_floor->startQueue));
+  }
+}
+
+int existsPassengerNode(simulation* sim) {
+  if (sim->queueCount == 0 && sim->elevatorCar.passengerCount == 0) {
+    return 0;
+  }
+  return 1;
+}
+
+int elevatorFull(simulation* sim) {
+  return sim->elevatorCar.passengerCount >= sim->capacity;
+}
+
+/* Next floor in direction where someone is waiting (unless the car is full) or getting off, or the end of the shaft
+ * if there is none. Same as the modules: only the nearest floor with work on each index is looked at.
+ */
+int nextStop(simulation* sim, int direction) {
+  int current_floor = sim->elevatorCar.current_floor->id;
+  int floor_num = current_floor + direction;
+  int waiting_floor;
+
+  if (floor_num <= 0 || floor_num >= sim->numFloors - 1) {
+    return floor_num;
+  }
+
+  floor_num = cachedNext(&sim->ridingFloors, current_floor, direction);
+  if (!elevatorFull(sim)) {
+    waiting_floor = cachedNext(&sim->waitingFloors, current_floor, direction);
+    if (waiting_floor >= 0 && (floor_num < 0 || (waiting_floor - floor_num) * direction < 0)) {
+      floor_num = waiting_floor;
+    }
+  }
+
+  if (floor_num <= 0 || floor_num >= sim->numFloors - 1) {
+    return direction > 0 ? sim->numFloors - 1 : 0;
+  }
+  return floor_num;
+}
+
+// Closest floor with work in index other than the current one, or -1 if there is none: only the nearest floor with
+// work above and below are looked at. Ties between floors the same distance away go to the lower id.
+int closestFloor(simulation* sim, floorIndex* index) {
+  int current_floor = sim->elevatorCar.current_floor->id;
+  int floor_up, floor_down, target, distance;
+
+  target = cachedAnswer(index, QUERY_CLOSEST, current_floor);
+  if (target == CACHE_MISS) {
+    floor_up = indexNext(index, current_floor, 1);
+    floor_down = indexNext(index, current_floor, -1);
+    if (floor_up >= 0 && (floor_down < 0 || floor_up - current_floor < current_floor - floor_down
+                          || (floor_up - current_floor == current_floor - floor_down
+                              && indexPriority(index, floor_up) < indexPriority(index, floor_down)))) {
+      target = floor_up;
+    }
+    else {
+      target = floor_down;
+    }
+    // Only floors at most as far away as the target can change it, or any floor if there is none
+    distance = target >= 0 ? abs(target - current_floor) : sim->numFloors;
+    cacheAnswer(index, QUERY_CLOSEST, current_floor, target, current_floor - distance, current_floor + distance);
+  }
+
+  return target;
+}
+
+// Target of the next move under the simulation's policy, like the modules' nextTarget, or -1 if there is none
+int nextTarget(simulation* sim) {
+  int target;
+
+  switch (sim->policy) {
+    case FCFS:
+      target = cachedLowest(&sim->ridingFloors);
+      return target >= 0 ? target : cachedLowest(&sim->waitingFloors);
+    case SDF:
+      return closestFloor(sim, sim->elevatorCar.passengerCount == 0 ? &sim->waitingFloors : &sim->ridingFloors);
+    case ROUND_ROBIN:
+      if (sim->numFloors < 2) {
+        return -1;
+      }
+      if (sim->elevatorCar.current_floor->id == 0) {
+        sim->elevatorDirection = 1;
+      }
+      else if (sim->elevatorCar.current_floor->id == sim->numFloors - 1) {
+        sim->elevatorDirection = -1;
+      }
+      return nextStop(sim, sim->elevatorDirection);
+  }
+
+  return -1;
+}
+
+int initializeFloorIndex(floorIndex* index, int num_floors) {
+  index->numFloors = num_floors;
+  index->tree = num_floors >= INDEX_MIN_FLOORS;
+  index->leaves = 1;
+  while (index->leaves < num_floors) {
+    index->leaves *= 2;
+  }
+  index->minId = calloc(2 * index->leaves, sizeof(int));
+  index->dirty = calloc((num_floors + 63) / 64, sizeof(uint64_t));
+  index->cache.query = QUERY_NONE;
+  if (index->minId == NULL || index->dirty == NULL) {
+    freeFloorIndex(index);
+    return -1;
+  }
+
+  return 0;
+}
+
+void freeFloorIndex(floorIndex* index) {
+  free(index->minId);
+  free(index->dirty);
+  index->minId = NULL;
+  index->dirty = NULL;
+}
+
+// Lower of two ids where 0 means no passenger. Compared as unsigned, 0 - 1 is the largest value so it never wins,
+// and the compiler needs no branch that random ids would keep mispredicting.
+int lowerId(int a, int b) {
+  return (unsigned int)a - 1 < (unsigned int)b - 1 ? a : b;
+}
+
+// Set the lowest passenger id on floor (0 if it has no work) and update the ranges above it
+void indexSet(floorIndex* index, int floor, int id) {
+  int node = index->leaves + floor;
+
+  // Enqueues, boarding and drop offs all come through here, so this flags every event
+  index->dirty[floor / 64] |= 1ULL << (floor % 64);
+  index->minId[node] = id;
+  if (!index->tree) {
+    return;
+  }
+  for (node /= 2; node >= 1; node /= 2) {
+    id = lowerId(index->minId[2 * node], index->minId[2 * node + 1]);
+    // The ranges further up only see this one through its lowest id, so they stay the same if it does
+    if (index->minId[node] == id) {
+      break;
+    }
+    index->minId[node] = id;
+  }
+}
+
+// Lowest passenger id on floor, 0 if it has no work
+int indexPriority(floorIndex* index, int floor) {
+  return index->minId[index->leaves + floor];
+}
+
+// Cached answer to query from floor, or CACHE_MISS if nothing is cached for them or one of the floors the answer
+// depends on has changed since
+int cachedAnswer(floorIndex* index, int query, int floor) {
+  indexCache* cache = &index->cache;
+  uint64_t bits;
+  int word;
+
+  if (cache->query != query || cache->from != floor) {
+    return CACHE_MISS;
+  }
+  for (word = cache->low / 64; cache->low <= cache->high && word <= cache->high / 64; word++) {
+    bits = index->dirty[word];
+    if (word == cache->low / 64) {
+      bits &= ~0ULL << (cache->low % 64);
+    }
+    if (word == cache->high / 64 && cache->high % 64 != 63) {
+      bits &= (1ULL << (cache->high % 64 + 1)) - 1;
+    }
+    if (bits != 0) {
+      return CACHE_MISS;
+    }
+  }
+
+  return cache->answer;
+}
+
+// Remember the answer to query from floor and the floors low..high it depends on, and track changes from now on
+void cacheAnswer(floorIndex* index, int query, int floor, int answer, int low, int high) {
+  indexCache* cache = &index->cache;
+
+  cache->query = query;
+  cache->from = floor;
+  cache->low = low < 0 ? 0 : low;
+  cache->high = high > index->numFloors - 1 ? index->numFloors - 1 : high;
+  cache->answer = answer;
+  memset(index->dirty, 0, (index->numFloors + 63) / 64 * sizeof(uint64_t));
+}
+
+// Floor with the lowest passenger id, or -1 if no floor has work
+int indexLowest(floorIndex* index) {
+  int node = 1;
+  int floor, lowest = -1;
+
+  if (!index->tree) {
+    for (floor = 0; floor < index->numFloors; floor++) {
+      if (index->minId[index->leaves + floor] != 0
+          && (lowest < 0 || index->minId[index->leaves + floor] < index->minId[index->leaves + lowest])) {
+        lowest = floor;
+      }
+    }
+    return lowest;
+  }
+
+  if (index->minId[1] == 0) {
+    return -1;
+  }
+
+  while (node < index->leaves) {
+    node = index->minId[2 * node] == index->minId[node] ? 2 * node : 2 * node + 1;
+  }
+
+  return node - index->leaves;
+}
+
+// indexLowest through the cache: it doesn't depend on where the car is, but a change on any floor can change it
+int cachedLowest(floorIndex* index) {
+  int lowest = cachedAnswer(index, QUERY_LOWEST, 0);
+
+  if (lowest == CACHE_MISS) {
+    lowest = indexLowest(index);
+    cacheAnswer(index, QUERY_LOWEST, 0, lowest, 0, index->numFloors - 1);
+  }
+
+  return lowest;
+}
+
+// Closest floor with work strictly above (direction 1) or below (direction -1) floor, or -1 if there is none
+int indexNext(floorIndex* index, int floor, int direction) {
+  int node = index->leaves + floor;
+  int sibling = 0;
+
+  if (!index->tree) {
+    for (floor += direction; floor >= 0 && floor < index->numFloors; floor += direction) {
+      if (index->minId[index->leaves + floor] != 0) {
+        return floor;
+      }
+    }
+    return -1;
+  }
+
+  // Climb until the sibling range on the direction side has work
+  while (node > 1) {
+    sibling = direction > 0 ? node + 1 : node - 1;
+    if ((direction > 0 ? node % 2 == 0 : node % 2 == 1) && index->minId[sibling] != 0) {
+      break;
+    }
+    node /= 2;
+  }
+  if (node == 1) {
+    return -1;
+  }
+
+  // Then descend into it, keeping to the child nearest floor that has work
+  node = sibling;
+  while (node < index->leaves) {
+    if (direction > 0) {
+      node = index->minId[2 * node] != 0 ? 2 * node : 2 * node + 1;
+    }
+    else {
+      node = index->minId[2 * node + 1] != 0 ? 2 * node + 1 : 2 * node;
+    }
+  }
+
+  return node - index->leaves;
+}
+
+// indexNext through the cache
+int cachedNext(floorIndex* index, int floor, int direction) {
+  int next = cachedAnswer(index, direction, floor);
+  int reach;
+
+  if (next == CACHE_MISS) {
+    next = indexNext(index, floor, direction);
+    // Only the floors from the car to the answer, or to the end of the shaft if there is none, can change it
+    reach = next >= 0 ? next : (direction > 0 ? index->numFloors - 1 : 0);
+    if (direction > 0) {
+      cacheAnswer(index, direction, floor, next, floor + 1, reach);
+    }
+    else {
+      cacheAnswer(index, direction, floor, next, reach, floor - 1);
+    }
+  }
+
+  return next;
+}
+
+static void decayDemand(demandRate* demand, long now) {
+  long periods;
+  int k;
+
+  if (demand->rate == 0) {
+    demand->stamp = now;
+    return;
+  }
+
+  periods = (now - demand->stamp) / DEMAND_PERIOD;
+  if (periods <= 0) {
+    return;
+  }
+  demand->stamp += periods * DEMAND_PERIOD;
+
+  for (k=0; periods != 0; k++, periods >>= 1) {
+    if (k == (int)(sizeof(demandDecay) / sizeof(demandDecay[0]))) {
+      demand->rate = 0;
+      break;
+    }
+    if (periods & 1) {
+      demand->rate = ((unsigned long long)demand->rate * demandDecay[k]) >> 16;
+    }
+  }
+}
+
+void updateDemand(simulation* sim, int origin) {
+  decayDemand(&sim->floorDemandArray[origin], sim->clock);
+  sim->floorDemandArray[origin].rate += DEMAND_INCREMENT;
+}
+
+unsigned long floorDemand(simulation* sim, int floor_num) {
+  decayDemand(&sim->floorDemandArray[floor_num], sim->clock);
+  return sim->floorDemandArray[floor_num].rate;
+}
+
+int parkingFloor(simulation* sim) {
+  int i;
+  int busiest_floor = 0;
+  unsigned long demand, busiest_demand;
+
+  if (sim->parkFloor >= 0 && sim->parkFloor < sim->numFloors) {
+    return sim->parkFloor;
+  }
+
+  busiest_demand = floorDemand(sim, 0);
+  for (i=1; i<sim->numFloors; i++) {
+    demand = floorDemand(sim, i);
+    if (demand > busiest_demand) {
+      busiest_demand = demand;
+      busiest_floor = i;
+    }
+  }
+
+  return busiest_floor;
+}
+
+// Queue drained: park, then skip ahead to the next arrival. Returns 1 if there is new work, 0 at the end of the trace.
+int waitForPassengers(simulation* sim) {
+  sim->drainTime = sim->clock;
+
+  if (sim->nextRequest >= sim->input->count) {
+    return 0;
+  }
+
+  moveElevatorTo(sim, parkingFloor(sim));
+
+  if (existsPassengerNode(sim) == 0 && sim->input->requests[sim->nextRequest].time > sim->clock) {
+    advanceClock(sim, sim->input->requests[sim->nextRequest].time - sim->clock);
+  }
+
+  return existsPassengerNode(sim);
+}
+
+// First come first serve: drop off the passenger in the car with the lowest id,
+// or if the car is empty, go to the floor of the waiting passenger with the lowest id
+void fcfsStep(simulation* sim) {
+  int next_destination = nextTarget(sim);
+
+  if (next_destination >= 0) {
+    moveElevatorTo(sim, next_destination);
+  }
+
+  if (sim->elevatorCar.passengerArray[sim->elevatorCar.current_floor->id] != NO_PASSENGER) {
+    dropOff(sim);
+  }
+}
+
+// Shortest distance first: if the car is empty, go to the closest floor with a waiting passenger and pick up,
+// then go to the closest drop off floor. Ties between floors the same distance away go to the lower id.
+void sdfStep(simulation* sim) {
+  int next_destination;
+
+  if (sim->elevatorCar.passengerCount == 0) {
+    next_destination = closestFloor(sim, &sim->waitingFloors);
+    if (next_destination >= 0) {
+      moveElevatorTo(sim, next_destination);
+    }
+    if (sim->elevatorCar.current_floor->startQueue != NO_PASSENGER) {
+      pickUp(sim);
+    }
+  }
+
+  next_destination = closestFloor(sim, &sim->ridingFloors);
+  if (next_destination >= 0) {
+    moveElevatorTo(sim, next_destination);
+  }
+
+  if (sim->elevatorCar.passengerArray[sim->elevatorCar.current_floor->id] != NO_PASSENGER) {
+    dropOff(sim);
+  }
+}
+
+// Round robin: sweep up and down the shaft, stopping wherever someone is waiting or getting off
+void roundRobinStep(simulation* sim) {
+  int next_destination = nextTarget(sim);
+
+  // A one floor building has nowhere to sweep to
+  if (next_destination >= 0) {
+    moveElevatorTo(sim, next_destination);
+  }
+
+  if (sim->elevatorCar.passengerArray[sim->elevatorCar.current_floor->id] != NO_PASSENGER) {
+    dropOff(sim);
+  }
+}
+
+/* Run a whole trace through the simulation, the same way thread_fn runs the modules:
+ * start at the first request, go to its floor, then loop until the trace is exhausted and the queue drains.
+ * Returns 0 on success, -1 if out of memory.
+ */
+int runSimulation(simulation* sim, const trace* input) {
+  int i;
+
+  free(sim->records);
+  sim->records = malloc((input->count ? input->count : 1) * sizeof(passengerRecord));
+  if (sim->records == NULL) {
+    return -1;
+  }
+  for (i=0; i<input->count; i++) {
+    sim->records[i].arrival = sim->records[i].board = sim->records[i].alight = -1;
+  }
+
+  sim->input = input;
+  sim->nextRequest = 0;
+  sim->numEvents = 0;
+  if (input->count == 0) {
+    return 0;
+  }
+
+  sim->clock = sim->startTime = sim->drainTime = input->requests[0].time;
+  sim->nextSample = sim->startTime;
+  sim->legStart = sim->legEnd = sim->startTime;
+  admitArrivals(sim);
+
+  moveElevatorTo(sim, input->requests[0].origin);
+  pickUp(sim);
+
+  while (existsPassengerNode(sim) > 0 || waitForPassengers(sim) > 0) {
+    // Check for pick up (a full car goes on to its drop offs instead)
+    if (sim->elevatorCar.current_floor->startQueue != NO_PASSENGER && !elevatorFull(sim)) {
+      pickUp(sim);
+    }
+
+    switch (sim->policy) {
+      case FCFS:
+        fcfsStep(sim);
+        break;
+      case SDF:
+        sdfStep(sim);
+        break;
+      case ROUND_ROBIN:
+        roundRobinStep(sim);
+        break;
+    }
+  }
+
+  return 0;
+}
+
+/* Sample the floor queues, car load and car position to file every interval ms of virtual time during the next
+ * runSimulation, starting at the first request. A NULL file or an interval <= 0 turns sampling off.
+ */
+void setSampler(simulation* sim, FILE* file, long interval) {
+  sim->sampleFile = interval > 0 ? file : NULL;
+  sim->sampleInterval = interval;
+}
+
+/* Log every car action and every change to a floor queue during the next runSimulation (on = 1), e.g. to draw a
+ * timeline of the run. The log is sim->events[0..numEvents-1]; logEvents is -1 afterwards if it ran out of memory.
+ */
+void setEventLog(simulation* sim, int on) {
+  sim->logEvents = on ? 1 : 0;
+  sim->numEvents = 0;
+}
+
+/* Place the car's floors on building floors levels[0..numFloors-1], in increasing order, for a car that only
+ * serves some floors of a taller building (e.g. the lobby and one zone). Travel times and floors traveled follow the
+ * building floors, so the run from the lobby to the zone is one nonstop express leg. Returns 0, or -1 if out of memory.
+ */
+int setFloorLevels(simulation* sim, const int* levels) {
+  free(sim->floorLevels);
+  sim->floorLevels = NULL;
+  if (levels == NULL) {
+    return 0;
+  }
+
+  if ((sim->floorLevels = malloc(sim->numFloors * sizeof(int))) == NULL) {
+    return -1;
+  }
+  memcpy(sim->floorLevels, levels, sim->numFloors * sizeof(int));
+  return 0;
+}
+
+void simulationResult(const simulation* sim, simResult* result) {
+  int i;
+  long wait;
+  const passengerRecord* record;
+
+  memset(result, 0, sizeof(*result));
+  result->makespan = sim->drainTime - sim->startTime;
+  result->stops = sim->stops;
+  result->floorsTraveled = sim->floorsTraveled;
+
+  for (i=0; i<sim->nextId - 1; i++) {
+    record = &sim->records[i];
+    if (record->alight < 0) {
+      continue;
+    }
+    wait = record->board - record->arrival;
+    result->delivered++;
+    result->totalWait += wait;
+    result->totalTrip += record->alight - record->arrival;
+    if (wait > result->maxWait) {
+      result->maxWait = wait;
+    }
+  }
+}
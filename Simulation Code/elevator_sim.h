@@ -0,0 +1,260 @@
+#ifndef ELEVATOR_SIM_H
+#define ELEVATOR_SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Userspace port of the elevator modules' scheduling code.
+ * Instead of sleeping, the simulation advances a virtual clock by the same amounts the modules sleep for,
+ * so a whole trace runs in microseconds. Function names match the modules so the two are easy to compare.
+ */
+
+// Default building, same as the modules. The car holds more in sdf and adaptive, see policyCapacity()
+#define NUM_FLOORS 6
+#define ELEVATOR_CAPACITY 8 // fcfs_policy.c and round_robin_policy.c
+#define SDF_CAPACITY 16 // sdf_policy.c and adaptive_policy.c
+
+// Kinematic motion macros, same as the modules (distances in mm, times in ms)
+#define FLOOR_HEIGHT 3000 // mm between two adjacent floors
+#define MAX_SPEED 2500 // mm/s
+#define ACCELERATION 1500 // mm/s^2, used when leaving a floor
+#define DECELERATION 1500 // mm/s^2, used when stopping at the target floor
+#define STOP_TIME 1000 // ms the doors stay open for a pick up or a drop off (the modules' msleep(1000))
+
+// Demand estimation macros, same as the modules
+#define DEMAND_SHIFT 10
+#define DEMAND_PERIOD 1000 // ms
+#define DEMAND_INCREMENT ((60 << DEMAND_SHIFT) / 32)
+
+// Scheduling policies
+#define FCFS 0
+#define SDF 1
+#define ROUND_ROBIN 2
+#define NUM_POLICIES 3
+
+/* Trace data structures */
+typedef struct tripRequest {
+  long time; // ms since the start of the trace
+  int origin;
+  int destination;
+} tripRequest;
+
+typedef struct trace {
+  tripRequest* requests; // sorted by time
+  int count;
+} trace;
+
+/* Passenger pool.
+ * The modules' passengerNode is one kmalloc'd node per passenger linked by pointers. Here passengers live in a
+ * pool of fixed size chunks, one array per field, and queues are linked by 32 bit indices into the pool, so a
+ * passenger costs 24 bytes instead of a 16 byte node plus allocator overhead, queue walks read dense arrays, and
+ * chunks never move once allocated. Slots of dropped off passengers are recycled through a free list.
+ */
+#define POOL_CHUNK_BITS 12
+#define POOL_CHUNK (1 << POOL_CHUNK_BITS) // passengers per chunk
+#define NO_PASSENGER UINT32_MAX // end of a queue, the pool's NULL
+
+typedef uint32_t passengerIndex;
+
+typedef struct passengerChunk {
+  int32_t id[POOL_CHUNK];
+  int32_t origin[POOL_CHUNK];
+  int32_t destination[POOL_CHUNK];
+  passengerIndex next[POOL_CHUNK]; // next passenger in the same floor queue or car list
+  int64_t arrival[POOL_CHUNK]; // virtual ms
+} passengerChunk;
+
+typedef struct passengerPool {
+  passengerChunk** chunks;
+  uint32_t numChunks;
+  uint32_t size; // slots handed out so far, recycled or not
+  passengerIndex freeList; // recycled slots, linked through next
+  uint32_t live; // passengers currently allocated
+} passengerPool;
+
+// Field of passenger p, e.g. POOL_FIELD(&sim->pool, destination, p) = 3
+#define POOL_FIELD(pool, field, p) ((pool)->chunks[(p) >> POOL_CHUNK_BITS]->field[(p) & (POOL_CHUNK - 1)])
+
+/* Elevator data structures */
+typedef struct floorQueue {
+  int id;
+  passengerIndex startQueue;
+  passengerIndex endQueue;
+} floorQueue;
+
+typedef struct elevator {
+  floorQueue* current_floor;
+  int passengerCount;
+  // one queue of passengers per destination floor, lowest id first
+  passengerIndex* passengerArray;
+} elevator;
+
+/* Active floor index, same as the modules' floorIndex but sized when the simulation starts */
+#define QUERY_NONE -2
+#define QUERY_CLOSEST 0 // closest floor with work, directions -1 and 1 are queries too
+#define QUERY_LOWEST 2 // floor with the lowest passenger id
+#define CACHE_MISS -2
+
+// Last answer the car got from a floor index and what it depends on: until the car moves or one of the floors
+// low..high changes the answer stays the same, so it is reused instead of searching the index again
+typedef struct indexCache {
+  int query; // QUERY_*, or a direction
+  int from; // car floor the answer was found from
+  int low, high;
+  int answer;
+} indexCache;
+
+// Buildings with fewer floors only keep the leaves and scan them: there the scan finds work within a few floors, which
+// costs less than keeping the ranges above the leaves up to date (see bench.c). Build with -DINDEX_MIN_FLOORS=0 to
+// always keep the whole tree.
+#ifndef INDEX_MIN_FLOORS
+#define INDEX_MIN_FLOORS 512
+#endif
+
+// Segment tree over the floors that need the car. Node 1 is the root, the children of node i are 2i and 2i + 1,
+// and floor f is the leaf leaves + f. Every node holds the lowest passenger id on its range of floors, or 0 if none
+// of them has work.
+typedef struct floorIndex {
+  int numFloors;
+  int leaves; // smallest power of two >= numFloors
+  int tree; // 0 if only the leaves are kept, see INDEX_MIN_FLOORS
+  int* minId; // 2 * leaves nodes
+  uint64_t* dirty; // one bit per floor changed since the cached answer was found
+  indexCache cache;
+} floorIndex;
+
+typedef struct demandRate {
+  unsigned long rate; // arrivals per minute << DEMAND_SHIFT
+  long stamp; // virtual ms when rate was last decayed
+} demandRate;
+
+typedef struct passengerRecord {
+  long arrival; // virtual ms, -1 until it happens
+  long board;
+  long alight;
+  int origin; // set at drop off, with arrival
+  int destination;
+} passengerRecord;
+
+// Event log kinds (see setEventLog)
+#define EVENT_MOVE 0 // floor = floor the car left, value = floor it goes to
+#define EVENT_PICKUP 1 // value = passengers boarded
+#define EVENT_DROPOFF 2 // value = passengers dropped off
+#define EVENT_QUEUE 3 // value = passengers now waiting on floor
+
+typedef struct simEvent {
+  long time; // virtual ms
+  long duration; // ms, 0 for EVENT_QUEUE
+  int type;
+  int floor;
+  int value;
+} simEvent;
+
+typedef struct simulation {
+  int numFloors;
+  int capacity;
+  int policy;
+  int parkFloor; // -1 = park at the floor with the highest estimated demand
+  int* floorLevels; // building floor of each of the car's floors, NULL = floor i is floor i (see setFloorLevels)
+
+  passengerPool pool;
+  floorQueue* shaftArray;
+  elevator elevatorCar;
+  demandRate* floorDemandArray;
+  int queueCount;
+  int nextId;
+  int elevatorDirection; // round robin sweep direction, 1 = up, -1 = down
+  floorIndex waitingFloors; // lowest waiting passenger id of every floor
+  floorIndex ridingFloors; // lowest id of the passengers in the car getting off at every floor
+
+  long clock; // virtual time in ms
+  long startTime; // first arrival
+  long drainTime; // last time the queue drained
+  const trace* input;
+  int nextRequest; // index of the first request that hasn't arrived yet
+  passengerRecord* records; // indexed by passenger id - 1
+
+  long stops;
+  long floorsTraveled;
+
+  // Optional time series, same line format as the modules' sampler (see setSampler)
+  FILE* sampleFile;
+  long sampleInterval; // virtual ms between samples
+  long nextSample; // virtual time of the next sample
+  int legFrom; // floor the last move started from
+  long legStart, legEnd; // virtual times the car left legFrom and reached current_floor
+
+  // Optional log of car actions and queue changes, in the order they happen (see setEventLog)
+  int logEvents; // 1 = on, 0 = off, -1 = ran out of memory
+  simEvent* events;
+  long numEvents;
+  long maxEvents;
+} simulation;
+
+typedef struct simResult {
+  int delivered;
+  long makespan; // ms from the first arrival until the queue drained for the last time
+  long totalWait; // sum over passengers of ms from arrival to boarding
+  long maxWait;
+  long totalTrip; // sum over passengers of ms from arrival to drop off
+  long stops;
+  long floorsTraveled;
+} simResult;
+
+// trace functions
+int loadTrace(const char*, trace*);
+void freeTrace(trace*);
+int generateTrace(trace*, int, double, int, unsigned long long);
+
+// passenger pool functions
+void initializePool(passengerPool*);
+void freePool(passengerPool*);
+passengerIndex allocatePassenger(passengerPool*);
+void releasePassenger(passengerPool*, passengerIndex);
+
+// simulation functions
+int initializeSimulation(simulation*, int, int, int);
+void freeSimulation(simulation*);
+int runSimulation(simulation*, const trace*);
+void simulationResult(const simulation*, simResult*);
+void setSampler(simulation*, FILE*, long);
+void setEventLog(simulation*, int);
+int setFloorLevels(simulation*, const int*);
+const char* policyName(int);
+int policyCapacity(int);
+int policyFromName(const char*);
+
+// elevator functions, ported from the modules
+unsigned int travelTime(int);
+int addPassengertoQueue(simulation*, int, int);
+int moveElevatorTo(simulation*, int);
+void pickUp(simulation*);
+void enterElevator(simulation*, passengerIndex);
+void dropOff(simulation*);
+int existsPassengerNode(simulation*);
+int elevatorFull(simulation*);
+int nextStop(simulation*, int);
+int closestFloor(simulation*, floorIndex*);
+int nextTarget(simulation*);
+void updateDemand(simulation*, int);
+unsigned long floorDemand(simulation*, int);
+int parkingFloor(simulation*);
+int waitForPassengers(simulation*);
+void fcfsStep(simulation*);
+void sdfStep(simulation*);
+void roundRobinStep(simulation*);
+
+// active floor index functions, ported from the modules
+int initializeFloorIndex(floorIndex*, int);
+void freeFloorIndex(floorIndex*);
+int lowerId(int, int);
+void indexSet(floorIndex*, int, int);
+int indexPriority(floorIndex*, int);
+int cachedAnswer(floorIndex*, int, int);
+void cacheAnswer(floorIndex*, int, int, int, int, int);
+int indexLowest(floorIndex*);
+int cachedLowest(floorIndex*);
+int indexNext(floorIndex*, int, int);
+int cachedNext(floorIndex*, int, int);
+
+#endif
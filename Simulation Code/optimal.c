@@ -0,0 +1,578 @@
+/* Offline optimal schedule solver.
+ * Reads a recorded passenger trace and finds, by branch and bound over the set of pending passengers,
+ * the schedule with the smallest makespan and (separately) the smallest total wait, then reports how far
+ * FCFS, SDF and round robin are from it. Costs are the modules': kinematic travel time per leg and
+ * STOP_TIME per pick up and per drop off.
+ *
+ * Schedules are sequences of stops. At each stop everyone getting off leaves, then the passengers waiting
+ * on that floor board in arrival order until the car is full, exactly like pickUp()/dropOff(). The solver
+ * knows the whole trace in advance, so it may send the car to a floor ahead of a passenger's arrival and wait
+ * there; the result is a lower bound on what any online algorithm can achieve with the same car.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "elevator_sim.h"
+
+#define MAX_PASSENGERS 64 // passenger sets are 64 bit masks
+#define MAX_RUNS 16 // measured runs that can be passed with -m
+#define TABLE_BITS 18 // per thread transposition table has 2^TABLE_BITS entries
+#define DEFAULT_NODE_LIMIT 50000000L
+
+#define MAKESPAN 0
+#define TOTAL_WAIT 1
+
+typedef struct searchState {
+  long time; // ms when the car is free to leave the current floor
+  long wait; // total wait of the passengers that have boarded so far
+  int floor;
+  uint64_t waiting; // passengers that haven't boarded yet
+  uint64_t riding; // passengers in the car
+  long bound; // lower bound on the objective for any completion of this state
+} searchState;
+
+typedef struct tableEntry {
+  uint64_t waiting;
+  uint64_t riding;
+  long time;
+  long wait;
+  int floor; // -1 = empty slot
+} tableEntry;
+
+typedef struct subproblem {
+  searchState root;
+  int complete; // 1 if the whole subtree was searched (or pruned)
+} subproblem;
+
+typedef struct workerState {
+  tableEntry* table;
+  searchState* children; // MAX_PASSENGERS * 2 levels of child buffers
+  int* mark; // per floor stamps used by the bound
+  int stamp;
+} workerState;
+
+/* Problem, shared read only by all workers */
+int numFloors = NUM_FLOORS;
+int capacity = ELEVATOR_CAPACITY;
+int numPassengers;
+long startTime;
+long arrival[MAX_PASSENGERS];
+int origin[MAX_PASSENGERS];
+int destination[MAX_PASSENGERS];
+uint64_t originMask[1024]; // passengers starting on each floor, filled for numFloors <= 1024
+uint64_t destinationMask[1024];
+long* legTime; // travelTime() for every floor distance
+int maxChildren;
+int objective;
+
+/* Search state shared by the workers */
+long incumbent;
+long nodeCount;
+long nodeLimit = DEFAULT_NODE_LIMIT;
+int nextSubproblem;
+subproblem* frontier;
+int frontierSize;
+
+static long atomicLoad(long* value) {
+  return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+// Lower the incumbent to candidate if it is better
+static void offerIncumbent(long candidate) {
+  long current = atomicLoad(&incumbent);
+
+  while (candidate < current) {
+    if (__atomic_compare_exchange_n(&incumbent, &current, candidate, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+}
+
+static long legBetween(int from, int to) {
+  return legTime[from > to ? from - to : to - from];
+}
+
+/* Admissible bounds.
+ * Makespan: the car has to cover the span of floors that still need a stop, with at least one STOP_TIME at each,
+ * and every passenger individually still needs its remaining legs and stops. Nonstop travel is never slower than
+ * travel with stops in between, so the span is charged as one nonstop run.
+ * Total wait: every waiting passenger boards no earlier than the car can reach its floor.
+ */
+static long lowerBound(workerState* worker, const searchState* state) {
+  int p, lo, hi, stops = 0, distance;
+  long span_bound, passenger_bound = state->time, completion, reach;
+  uint64_t remaining;
+
+  if (objective == TOTAL_WAIT) {
+    long bound = state->wait;
+    for (remaining = state->waiting; remaining; remaining &= remaining - 1) {
+      p = __builtin_ctzll(remaining);
+      reach = state->time + legBetween(state->floor, origin[p]);
+      if (reach > arrival[p]) {
+        bound += reach - arrival[p];
+      }
+    }
+    return bound;
+  }
+
+  if (state->waiting == 0 && state->riding == 0) {
+    return state->time - startTime;
+  }
+
+  worker->stamp++;
+  lo = hi = state->floor;
+
+  for (remaining = state->riding; remaining; remaining &= remaining - 1) {
+    p = __builtin_ctzll(remaining);
+    if (worker->mark[destination[p]] != worker->stamp) {
+      worker->mark[destination[p]] = worker->stamp;
+      stops++;
+    }
+    lo = destination[p] < lo ? destination[p] : lo;
+    hi = destination[p] > hi ? destination[p] : hi;
+    completion = state->time + legBetween(state->floor, destination[p]) + STOP_TIME;
+    passenger_bound = completion > passenger_bound ? completion : passenger_bound;
+  }
+
+  for (remaining = state->waiting; remaining; remaining &= remaining - 1) {
+    p = __builtin_ctzll(remaining);
+    if (worker->mark[origin[p]] != worker->stamp) {
+      worker->mark[origin[p]] = worker->stamp;
+      stops++;
+    }
+    if (worker->mark[destination[p]] != worker->stamp) {
+      worker->mark[destination[p]] = worker->stamp;
+      stops++;
+    }
+    lo = origin[p] < lo ? origin[p] : lo;
+    hi = origin[p] > hi ? origin[p] : hi;
+    lo = destination[p] < lo ? destination[p] : lo;
+    hi = destination[p] > hi ? destination[p] : hi;
+
+    reach = state->time + legBetween(state->floor, origin[p]);
+    completion = (reach > arrival[p] ? reach : arrival[p]) + STOP_TIME + legBetween(origin[p], destination[p]) + STOP_TIME;
+    passenger_bound = completion > passenger_bound ? completion : passenger_bound;
+  }
+
+  distance = (state->floor - lo) < (hi - state->floor) ? (state->floor - lo) : (hi - state->floor);
+  distance += hi - lo;
+  span_bound = state->time + travelTime(distance) + (long)stops * STOP_TIME;
+
+  return (span_bound > passenger_bound ? span_bound : passenger_bound) - startTime;
+}
+
+/* Stop at floor_num, arriving no earlier than earliest. Drops everyone off, then boards whoever is waiting there
+ * in arrival order until the car is full. Returns 0 if the stop would do nothing.
+ */
+static int applyStop(const searchState* state, int floor_num, long earliest, searchState* out) {
+  int p, riders;
+  long time = state->time + legBetween(state->floor, floor_num);
+  uint64_t dropped, candidates, boarded = 0;
+
+  if (time < earliest) {
+    time = earliest;
+  }
+
+  *out = *state;
+  out->floor = floor_num;
+
+  dropped = state->riding & destinationMask[floor_num];
+  riders = __builtin_popcountll(state->riding & ~dropped);
+  if (dropped) {
+    time += STOP_TIME;
+  }
+
+  for (candidates = state->waiting & originMask[floor_num]; candidates && riders < capacity; candidates &= candidates - 1) {
+    p = __builtin_ctzll(candidates);
+    // passengers are numbered in arrival order, so nobody after p has arrived either
+    if (arrival[p] > time) {
+      break;
+    }
+    boarded |= 1ULL << p;
+    out->wait += time - arrival[p];
+    riders++;
+  }
+
+  if (!dropped && !boarded) {
+    return 0;
+  }
+  if (boarded) {
+    time += STOP_TIME;
+  }
+
+  out->time = time;
+  out->riding = (state->riding & ~dropped) | boarded;
+  out->waiting = state->waiting & ~boarded;
+  return 1;
+}
+
+static int compareBound(const void* a, const void* b) {
+  long x = ((const searchState*)a)->bound, y = ((const searchState*)b)->bound;
+  return x < y ? -1 : x > y;
+}
+
+/* Generate every useful next stop from state into children, sorted by bound. For each floor: go there as soon as
+ * possible, or go there and wait for one of the passengers who hasn't arrived yet.
+ */
+static int expand(workerState* worker, const searchState* state, searchState* children) {
+  int floor_num, p, count = 0, riders_after_drop;
+  long reach, previous_arrival;
+  uint64_t dropping, candidates;
+
+  for (floor_num=0; floor_num<numFloors; floor_num++) {
+    dropping = state->riding & destinationMask[floor_num];
+    candidates = state->waiting & originMask[floor_num];
+    if (!dropping && !candidates) {
+      continue;
+    }
+
+    reach = state->time + legBetween(state->floor, floor_num) + (dropping ? STOP_TIME : 0);
+    if (applyStop(state, floor_num, 0, &children[count])) {
+      children[count].bound = lowerBound(worker, &children[count]);
+      count++;
+    }
+
+    // A full car can't serve hall calls, so there is no point waiting for anyone
+    riders_after_drop = __builtin_popcountll(state->riding & ~dropping);
+    if (riders_after_drop >= capacity) {
+      continue;
+    }
+
+    previous_arrival = reach;
+    for (; candidates; candidates &= candidates - 1) {
+      p = __builtin_ctzll(candidates);
+      if (arrival[p] <= previous_arrival) {
+        continue;
+      }
+      previous_arrival = arrival[p];
+      if (applyStop(state, floor_num, dropping ? arrival[p] - STOP_TIME : arrival[p], &children[count])) {
+        children[count].bound = lowerBound(worker, &children[count]);
+        count++;
+      }
+    }
+  }
+
+  qsort(children, count, sizeof(searchState), compareBound);
+  return count;
+}
+
+// Returns 1 if state is dominated by one already searched: same floor and passengers, no later and no more wait
+static int dominated(workerState* worker, const searchState* state) {
+  uint64_t hash = (state->waiting * 0x9E3779B97F4A7C15ULL) ^ (state->riding * 0xC2B2AE3D27D4EB4FULL) ^ (uint64_t)state->floor;
+  tableEntry* entry = &worker->table[(hash >> 17) & ((1UL << TABLE_BITS) - 1)];
+
+  if (entry->floor == state->floor && entry->waiting == state->waiting && entry->riding == state->riding
+      && entry->time <= state->time && (objective == MAKESPAN || entry->wait <= state->wait)) {
+    return 1;
+  }
+
+  entry->floor = state->floor;
+  entry->waiting = state->waiting;
+  entry->riding = state->riding;
+  entry->time = state->time;
+  entry->wait = state->wait;
+  return 0;
+}
+
+/* Depth first branch and bound. Returns 0 if the node limit was hit, so the subtree is not fully searched.
+ */
+static int search(workerState* worker, const searchState* state, int depth) {
+  int i, count;
+  searchState* children = &worker->children[(long)depth * maxChildren];
+
+  if (__atomic_add_fetch(&nodeCount, 1, __ATOMIC_RELAXED) > nodeLimit) {
+    return 0;
+  }
+
+  if (state->waiting == 0 && state->riding == 0) {
+    offerIncumbent(objective == MAKESPAN ? state->time - startTime : state->wait);
+    return 1;
+  }
+
+  if (state->bound >= atomicLoad(&incumbent) || dominated(worker, state)) {
+    return 1;
+  }
+
+  count = expand(worker, state, children);
+  for (i=0; i<count; i++) {
+    if (children[i].bound >= atomicLoad(&incumbent)) {
+      break; // sorted by bound, so the rest are no better
+    }
+    if (!search(worker, &children[i], depth + 1)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static int initializeWorker(workerState* worker) {
+  int i;
+
+  worker->table = malloc(sizeof(tableEntry) << TABLE_BITS);
+  worker->children = malloc(sizeof(searchState) * (long)maxChildren * (2 * MAX_PASSENGERS + 1));
+  worker->mark = calloc(numFloors, sizeof(int));
+  worker->stamp = 0;
+  if (worker->table == NULL || worker->children == NULL || worker->mark == NULL) {
+    return -1;
+  }
+  for (i=0; i<(1 << TABLE_BITS); i++) {
+    worker->table[i].floor = -1;
+  }
+  return 0;
+}
+
+static void freeWorker(workerState* worker) {
+  free(worker->table);
+  free(worker->children);
+  free(worker->mark);
+}
+
+static void* workerThread(void* arg) {
+  int i;
+  workerState worker;
+
+  (void)arg;
+  if (initializeWorker(&worker) < 0) {
+    fprintf(stderr, "optimal: out of memory\n");
+    exit(1);
+  }
+
+  while ((i = __atomic_fetch_add(&nextSubproblem, 1, __ATOMIC_RELAXED)) < frontierSize) {
+    frontier[i].complete = search(&worker, &frontier[i].root, 0);
+  }
+
+  freeWorker(&worker);
+  return NULL;
+}
+
+/* Solve for the current objective with num_threads workers.
+ * The first levels of the tree are expanded breadth first into independent subproblems that the workers pull
+ * from a shared counter, best bound first; all of them prune against one shared incumbent.
+ * Returns the best schedule found and sets *lower_bound (equal to it when the search finished).
+ */
+static long solve(int num_threads, long* lower_bound) {
+  int i, j, count, level_size;
+  long bound;
+  searchState root, *children, *next_level;
+  workerState worker;
+  pthread_t* threads;
+
+  if (initializeWorker(&worker) < 0) {
+    fprintf(stderr, "optimal: out of memory\n");
+    exit(1);
+  }
+
+  memset(&root, 0, sizeof(root));
+  root.time = startTime;
+  root.waiting = numPassengers == 64 ? ~0ULL : (1ULL << numPassengers) - 1;
+  root.bound = lowerBound(&worker, &root);
+
+  incumbent = LONG_MAX;
+  nodeCount = 0;
+
+  // Greedy dive for a first incumbent: always take the child with the best bound
+  {
+    searchState current = root;
+    while (current.waiting || current.riding) {
+      count = expand(&worker, &current, worker.children);
+      current = worker.children[0];
+    }
+    offerIncumbent(objective == MAKESPAN ? current.time - startTime : current.wait);
+  }
+
+  // Breadth first expansion until there are enough subproblems to keep every thread busy
+  frontier = malloc(sizeof(subproblem));
+  frontier[0].root = root;
+  frontierSize = 1;
+  for (level_size = 0; frontierSize < num_threads * 16 && frontierSize != level_size;) {
+    level_size = frontierSize;
+    nodeCount += level_size;
+    next_level = malloc(sizeof(searchState) * (long)level_size * maxChildren);
+    count = 0;
+    for (i=0; i<level_size; i++) {
+      if (frontier[i].root.waiting == 0 && frontier[i].root.riding == 0) {
+        next_level[count++] = frontier[i].root;
+        continue;
+      }
+      children = &next_level[count];
+      count += expand(&worker, &frontier[i].root, children);
+    }
+    free(frontier);
+    frontier = malloc(sizeof(subproblem) * (count ? count : 1));
+    for (i=0, j=0; i<count; i++) {
+      if (next_level[i].waiting == 0 && next_level[i].riding == 0) {
+        offerIncumbent(objective == MAKESPAN ? next_level[i].time - startTime : next_level[i].wait);
+      }
+      else if (next_level[i].bound < incumbent) {
+        frontier[j++].root = next_level[i];
+      }
+    }
+    free(next_level);
+    frontierSize = j;
+    if (frontierSize == 0) {
+      break;
+    }
+    qsort(frontier, frontierSize, sizeof(subproblem), compareBound);
+  }
+  freeWorker(&worker);
+
+  nextSubproblem = 0;
+  threads = malloc(sizeof(pthread_t) * num_threads);
+  for (i=0; i<num_threads; i++) {
+    pthread_create(&threads[i], NULL, workerThread, NULL);
+  }
+  for (i=0; i<num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  // Whatever wasn't searched completely still bounds the optimum from below by its root bound
+  *lower_bound = incumbent;
+  for (i=0; i<frontierSize; i++) {
+    bound = frontier[i].root.bound;
+    if (!frontier[i].complete && bound < *lower_bound) {
+      *lower_bound = bound;
+    }
+  }
+  if (root.bound > *lower_bound) {
+    *lower_bound = root.bound;
+  }
+
+  free(frontier);
+  return incumbent;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-f floors] [-c capacity] [-j threads] [-n node_limit] [-m name=seconds]... trace_file\n", name);
+  fprintf(stderr, "  -m records the makespan of an actual module run (the \"Total sec\" it printed) to compare as well\n");
+  exit(1);
+}
+
+static void printGap(const char* name, double value, long best, long lower_bound) {
+  if (best == lower_bound) {
+    printf("  %-14s %10.3f  gap %6.2f%%\n", name, value / 1000, best ? 100.0 * (value - best) / best : 0.0);
+  }
+  else {
+    printf("  %-14s %10.3f  gap %6.2f%% .. %6.2f%%\n", name, value / 1000,
+           best ? 100.0 * (value - best) / best : 0.0, lower_bound ? 100.0 * (value - lower_bound) / lower_bound : 0.0);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  int opt, i, num_threads, num_runs = 0, policy;
+  char* run_names[MAX_RUNS];
+  double run_seconds[MAX_RUNS];
+  char* separator;
+  long best[2], lower_bound[2];
+  trace input;
+  simulation sim;
+  simResult results[NUM_POLICIES];
+
+  num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  while ((opt = getopt(argc, argv, "f:c:j:n:m:")) != -1) {
+    switch (opt) {
+      case 'f':
+        numFloors = atoi(optarg);
+        break;
+      case 'c':
+        capacity = atoi(optarg);
+        break;
+      case 'j':
+        num_threads = atoi(optarg);
+        break;
+      case 'n':
+        nodeLimit = atol(optarg);
+        break;
+      case 'm':
+        separator = strchr(optarg, '=');
+        if (separator == NULL || num_runs == MAX_RUNS) {
+          usage(argv[0]);
+        }
+        *separator = 0;
+        run_names[num_runs] = optarg;
+        run_seconds[num_runs++] = atof(separator + 1);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || numFloors < 1 || numFloors > 1024 || capacity < 1 || num_threads < 1) {
+    usage(argv[0]);
+  }
+
+  if (loadTrace(argv[optind], &input) < 0) {
+    return 1;
+  }
+
+  // Requests the modules would reject never become passengers
+  for (i=0; i<input.count; i++) {
+    if (input.requests[i].origin < 0 || input.requests[i].origin > numFloors - 1
+        || input.requests[i].destination < 0 || input.requests[i].destination > numFloors - 1) {
+      fprintf(stderr, "optimal: skipping request %d, floor out of range\n", i + 1);
+      continue;
+    }
+    if (numPassengers == MAX_PASSENGERS) {
+      fprintf(stderr, "optimal: traces are limited to %d passengers\n", MAX_PASSENGERS);
+      return 1;
+    }
+    arrival[numPassengers] = input.requests[i].time;
+    origin[numPassengers] = input.requests[i].origin;
+    destination[numPassengers] = input.requests[i].destination;
+    originMask[origin[numPassengers]] |= 1ULL << numPassengers;
+    destinationMask[destination[numPassengers]] |= 1ULL << numPassengers;
+    numPassengers++;
+  }
+  if (numPassengers == 0) {
+    fprintf(stderr, "optimal: empty trace\n");
+    return 1;
+  }
+  startTime = arrival[0];
+
+  legTime = malloc(sizeof(long) * numFloors);
+  for (i=0; i<numFloors; i++) {
+    legTime[i] = travelTime(i);
+  }
+  maxChildren = numFloors * (numPassengers + 1);
+
+  for (policy=0; policy<NUM_POLICIES; policy++) {
+    if (initializeSimulation(&sim, numFloors, capacity, policy) < 0 || runSimulation(&sim, &input) < 0) {
+      fprintf(stderr, "optimal: out of memory\n");
+      return 1;
+    }
+    simulationResult(&sim, &results[policy]);
+    freeSimulation(&sim);
+  }
+
+  printf("%d passengers, %d floors, capacity %d, %d threads\n", numPassengers, numFloors, capacity, num_threads);
+
+  for (objective=MAKESPAN; objective<=TOTAL_WAIT; objective++) {
+    best[objective] = solve(num_threads, &lower_bound[objective]);
+    printf("\n%s (s): ", objective == MAKESPAN ? "makespan" : "total wait");
+    if (best[objective] == lower_bound[objective]) {
+      printf("optimal %.3f (%ld nodes)\n", best[objective] / 1000.0, nodeCount);
+    }
+    else {
+      printf("between %.3f and %.3f, node limit reached\n", lower_bound[objective] / 1000.0, best[objective] / 1000.0);
+    }
+
+    for (policy=0; policy<NUM_POLICIES; policy++) {
+      printGap(policyName(policy), objective == MAKESPAN ? results[policy].makespan : results[policy].totalWait,
+               best[objective], lower_bound[objective]);
+    }
+    if (objective == MAKESPAN) {
+      for (i=0; i<num_runs; i++) {
+        printGap(run_names[i], run_seconds[i] * 1000, best[objective], lower_bound[objective]);
+      }
+    }
+  }
+
+  free(legTime);
+  freeTrace(&input);
+  return 0;
+}
@@ -0,0 +1,173 @@
+/* Trace replay.
+ * Runs one simulated algorithm over a recorded trace, prints how it did, and optionally writes a time series of the
+ * floor queues, car load and car position sampled in virtual time, in the same format as the modules' sampler, so
+ * floor x time congestion heatmaps can be drawn the same way for a module run and for its simulation.
+ * It can also write the run as a Chrome trace (JSON trace event format), which chrome://tracing and the Perfetto
+ * UI open as a timeline: car moves and stops are slices, each passenger is an async span from arrival through
+ * boarding to drop off, and each floor's queue is a counter.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "elevator_sim.h"
+
+// Chrome trace timestamps are in microseconds, relative to the first request
+#define TRACE_TIME(sim, ms) (((ms) - (sim)->startTime) * 1000L)
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-p policy] [-f floors] [-c capacity] [-i interval_ms] [-o samples_file]\n"
+                  "          [-t timeline.json] <trace_file>\n", name);
+  fprintf(stderr, "  policy: fcfs, sdf or round_robin (default sdf)\n");
+  fprintf(stderr, "  capacity defaults to the policy's module: 16 for sdf, 8 otherwise\n");
+  fprintf(stderr, "  -i samples every interval_ms of virtual time to -o (default standard output)\n");
+  fprintf(stderr, "  -t writes a Chrome trace of the run for chrome://tracing or ui.perfetto.dev\n");
+  exit(1);
+}
+
+/* Write the run as a Chrome trace.
+ * Process 1 is the building: thread 1 is the car, counters "floor N" are the passengers waiting on each floor.
+ * Passengers are async spans keyed by id, with nested "waiting" and "riding" spans.
+ */
+static void writeTimeline(FILE* out, const simulation* sim) {
+  long i;
+  int floors;
+  const simEvent* event;
+  const passengerRecord* record;
+
+  fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(out, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"elevator (%s)\"}},\n",
+          policyName(sim->policy));
+  fprintf(out, "{\"ph\":\"M\",\"pid\":1,\"tid\":1,\"name\":\"thread_name\",\"args\":{\"name\":\"car\"}}");
+
+  for (i=0; i<sim->numEvents; i++) {
+    event = &sim->events[i];
+    switch (event->type) {
+      case EVENT_MOVE:
+        floors = event->value > event->floor ? event->value - event->floor : event->floor - event->value;
+        fprintf(out, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":1,\"cat\":\"car\",\"name\":\"move %d -> %d\",\"ts\":%ld,\"dur\":%ld,"
+                "\"args\":{\"floors\":%d}}", event->floor, event->value, TRACE_TIME(sim, event->time),
+                event->duration * 1000L, floors);
+        break;
+      case EVENT_PICKUP:
+      case EVENT_DROPOFF:
+        fprintf(out, ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":1,\"cat\":\"car\",\"name\":\"%s at %d\",\"ts\":%ld,\"dur\":%ld,"
+                "\"args\":{\"passengers\":%d}}", event->type == EVENT_PICKUP ? "pick up" : "drop off", event->floor,
+                TRACE_TIME(sim, event->time), event->duration * 1000L, event->value);
+        break;
+      case EVENT_QUEUE:
+        fprintf(out, ",\n{\"ph\":\"C\",\"pid\":1,\"name\":\"floor %d\",\"ts\":%ld,\"args\":{\"waiting\":%d}}",
+                event->floor, TRACE_TIME(sim, event->time), event->value);
+        break;
+    }
+  }
+
+  for (i=0; i<sim->nextId - 1; i++) {
+    record = &sim->records[i];
+    if (record->alight < 0) {
+      continue;
+    }
+    fprintf(out, ",\n{\"ph\":\"b\",\"pid\":1,\"cat\":\"passenger\",\"id\":%ld,\"name\":\"passenger %ld: %d -> %d\","
+            "\"ts\":%ld}", i + 1, i + 1, record->origin, record->destination, TRACE_TIME(sim, record->arrival));
+    fprintf(out, ",\n{\"ph\":\"b\",\"pid\":1,\"cat\":\"passenger\",\"id\":%ld,\"name\":\"waiting\",\"ts\":%ld}",
+            i + 1, TRACE_TIME(sim, record->arrival));
+    fprintf(out, ",\n{\"ph\":\"e\",\"pid\":1,\"cat\":\"passenger\",\"id\":%ld,\"name\":\"waiting\",\"ts\":%ld}",
+            i + 1, TRACE_TIME(sim, record->board));
+    fprintf(out, ",\n{\"ph\":\"b\",\"pid\":1,\"cat\":\"passenger\",\"id\":%ld,\"name\":\"riding\",\"ts\":%ld}",
+            i + 1, TRACE_TIME(sim, record->board));
+    fprintf(out, ",\n{\"ph\":\"e\",\"pid\":1,\"cat\":\"passenger\",\"id\":%ld,\"name\":\"riding\",\"ts\":%ld}",
+            i + 1, TRACE_TIME(sim, record->alight));
+    fprintf(out, ",\n{\"ph\":\"e\",\"pid\":1,\"cat\":\"passenger\",\"id\":%ld,\"name\":\"passenger %ld: %d -> %d\","
+            "\"ts\":%ld}", i + 1, i + 1, record->origin, record->destination, TRACE_TIME(sim, record->alight));
+  }
+
+  fprintf(out, "\n]}\n");
+}
+
+int main(int argc, char* argv[]) {
+  int opt;
+  int policy = SDF, floors = NUM_FLOORS, capacity = -1;
+  long interval = 0;
+  FILE* samples = stdout;
+  FILE* timeline = NULL;
+  trace input;
+  simulation sim;
+  simResult result;
+
+  while ((opt = getopt(argc, argv, "p:f:c:i:o:t:")) != -1) {
+    switch (opt) {
+      case 'p':
+        if ((policy = policyFromName(optarg)) < 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'f':
+        floors = atoi(optarg);
+        break;
+      case 'c':
+        capacity = atoi(optarg);
+        break;
+      case 'i':
+        interval = atol(optarg);
+        break;
+      case 'o':
+        if ((samples = fopen(optarg, "w")) == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      case 't':
+        if ((timeline = fopen(optarg, "w")) == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (capacity == -1) {
+    capacity = policyCapacity(policy);
+  }
+  if (optind != argc - 1 || floors < 2 || capacity < 1 || interval < 0) {
+    usage(argv[0]);
+  }
+
+  if (loadTrace(argv[optind], &input) < 0) {
+    fprintf(stderr, "replay: could not read trace %s\n", argv[optind]);
+    return 1;
+  }
+
+  if (initializeSimulation(&sim, floors, capacity, policy) < 0) {
+    fprintf(stderr, "replay: out of memory\n");
+    return 1;
+  }
+  setSampler(&sim, samples, interval);
+  setEventLog(&sim, timeline != NULL);
+  if (runSimulation(&sim, &input) < 0 || sim.logEvents < 0) {
+    fprintf(stderr, "replay: out of memory\n");
+    return 1;
+  }
+  simulationResult(&sim, &result);
+
+  // Keep the summary out of the way of samples written to standard output
+  fprintf(interval > 0 && samples == stdout ? stderr : stdout,
+          "%s: %d delivered, makespan %.3f s, mean wait %.3f s, max wait %.3f s, mean trip %.3f s, %ld stops, "
+          "%ld floors traveled\n",
+          policyName(policy), result.delivered, result.makespan / 1000.0,
+          result.delivered ? result.totalWait / 1000.0 / result.delivered : 0.0, result.maxWait / 1000.0,
+          result.delivered ? result.totalTrip / 1000.0 / result.delivered : 0.0, result.stops, result.floorsTraveled);
+
+  if (timeline != NULL) {
+    writeTimeline(timeline, &sim);
+    fclose(timeline);
+  }
+
+  freeSimulation(&sim);
+  freeTrace(&input);
+  if (samples != stdout) {
+    fclose(samples);
+  }
+
+  return 0;
+}
@@ -0,0 +1,353 @@
+/* Parameter sweep driver.
+ * Runs the simulated algorithms over every combination of policy x floors x capacity x arrival rate x seed and
+ * writes one CSV row per simulation. Each point gets a generated trace (same passenger mix as test_code.c) that only
+ * depends on its floors, rate and seed, so every policy and capacity is compared on exactly the same passengers.
+ *
+ * Points are numbered 0..N-1 and split into one contiguous range per thread. A thread takes points from the front
+ * of its own range; when it runs out it steals the back half of another thread's range, so threads that got cheap
+ * points (few floors, low rates) help the ones that didn't without any shared queue in the common path.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "elevator_sim.h"
+
+#define MAX_VALUES 256 // values per swept parameter
+#define OUTPUT_CHUNK 65536 // bytes of CSV a thread buffers before taking the output lock
+
+typedef struct workRange {
+  pthread_mutex_t lock;
+  long next; // first point not taken yet
+  long end;
+} workRange;
+
+typedef struct sweepWorker {
+  workRange range;
+  pthread_t thread;
+  int id;
+  unsigned int victim; // where to start looking when stealing
+  char* buffer;
+  size_t used;
+  long steals;
+} __attribute__((aligned(64))) sweepWorker; // one cache line per worker so the range locks don't share
+
+/* Grid, read only while the workers run */
+int policies[NUM_POLICIES];
+int numPolicies;
+double floorValues[MAX_VALUES], capacityValues[MAX_VALUES], rateValues[MAX_VALUES];
+int numFloorValues = 1, numCapacityValues = 1, numRateValues = 1;
+int numSeeds = 10;
+int numPassengers = 30;
+unsigned long long baseSeed = 1;
+long totalPoints;
+
+sweepWorker* workers;
+int numWorkers;
+long unclaimed; // points no thread has taken yet, 0 means everything is done or in progress
+FILE* output;
+pthread_mutex_t outputLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Parse "a,b,c" or "lo:hi:step" (or a mix, "1,4:10:2") into values. Returns the number of values, -1 on error.
+ */
+static int parseList(const char* text, double* values) {
+  int count = 0;
+  double lo, hi, step, value;
+  char* copy = strdup(text), *item, *save;
+
+  for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    if (sscanf(item, "%lf:%lf:%lf", &lo, &hi, &step) == 3) {
+      if (step <= 0) {
+        count = -1;
+        break;
+      }
+      for (value = lo; value <= hi + step * 1e-9 && count < MAX_VALUES; value += step) {
+        values[count++] = value;
+      }
+    }
+    else if (sscanf(item, "%lf", &value) == 1 && count < MAX_VALUES) {
+      values[count++] = value;
+    }
+    else {
+      count = -1;
+      break;
+    }
+  }
+
+  free(copy);
+  return count;
+}
+
+static int parsePolicies(const char* text) {
+  char* copy = strdup(text), *item, *save;
+  int policy;
+
+  numPolicies = 0;
+  for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    if (strcmp(item, "all") == 0) {
+      for (policy=0; policy<NUM_POLICIES; policy++) {
+        policies[policy] = policy;
+      }
+      numPolicies = NUM_POLICIES;
+    }
+    else if ((policy = policyFromName(item)) >= 0 && numPolicies < NUM_POLICIES) {
+      policies[numPolicies++] = policy;
+    }
+    else {
+      free(copy);
+      return -1;
+    }
+  }
+
+  free(copy);
+  return numPolicies;
+}
+
+static void flushOutput(sweepWorker* worker) {
+  pthread_mutex_lock(&outputLock);
+  fwrite(worker->buffer, 1, worker->used, output);
+  pthread_mutex_unlock(&outputLock);
+  worker->used = 0;
+}
+
+/* Take the next point for worker, stealing if its own range is empty. Returns -1 when there is nothing left.
+ */
+static long takePoint(sweepWorker* worker) {
+  int i;
+  long point, take_from, take_to;
+  sweepWorker* victim;
+
+  for (;;) {
+    pthread_mutex_lock(&worker->range.lock);
+    if (worker->range.next < worker->range.end) {
+      point = worker->range.next++;
+      pthread_mutex_unlock(&worker->range.lock);
+      __atomic_sub_fetch(&unclaimed, 1, __ATOMIC_RELAXED);
+      return point;
+    }
+    pthread_mutex_unlock(&worker->range.lock);
+
+    if (__atomic_load_n(&unclaimed, __ATOMIC_RELAXED) == 0) {
+      return -1;
+    }
+
+    // Steal the back half of the first non empty range, starting somewhere different every time
+    take_from = take_to = 0;
+    for (i=1; i<numWorkers && take_from == take_to; i++) {
+      victim = &workers[(worker->id + worker->victim + i) % numWorkers];
+      pthread_mutex_lock(&victim->range.lock);
+      if (victim->range.next < victim->range.end) {
+        take_to = victim->range.end;
+        take_from = victim->range.end - (victim->range.end - victim->range.next + 1) / 2;
+        victim->range.end = take_from;
+      }
+      pthread_mutex_unlock(&victim->range.lock);
+    }
+    worker->victim++;
+
+    if (take_from < take_to) {
+      pthread_mutex_lock(&worker->range.lock);
+      worker->range.next = take_from;
+      worker->range.end = take_to;
+      pthread_mutex_unlock(&worker->range.lock);
+      worker->steals++;
+    }
+    else {
+      // Points are in flight between two other threads, look again
+      sched_yield();
+    }
+  }
+}
+
+/* Simulate one point of the grid and buffer its CSV row.
+ * Point numbers are mixed radix with the seed varying fastest and the policy slowest.
+ */
+static void runPoint(sweepWorker* worker, long point) {
+  int seed_index, rate_index, capacity_index, floor_index, policy, floors, capacity;
+  double rate;
+  unsigned long long seed;
+  trace input;
+  simulation sim;
+  simResult result;
+
+  seed_index = point % numSeeds;
+  point /= numSeeds;
+  rate_index = point % numRateValues;
+  point /= numRateValues;
+  capacity_index = point % numCapacityValues;
+  point /= numCapacityValues;
+  floor_index = point % numFloorValues;
+  policy = policies[point / numFloorValues];
+
+  floors = (int)floorValues[floor_index];
+  capacity = (int)capacityValues[capacity_index];
+  rate = rateValues[rate_index];
+  seed = baseSeed * 0x9E3779B97F4A7C15ULL + ((unsigned long long)floor_index << 48)
+         + ((unsigned long long)rate_index << 32) + seed_index;
+
+  if (generateTrace(&input, floors, rate, numPassengers, seed) < 0
+      || initializeSimulation(&sim, floors, capacity, policy) < 0 || runSimulation(&sim, &input) < 0) {
+    fprintf(stderr, "sweep: out of memory\n");
+    exit(1);
+  }
+  simulationResult(&sim, &result);
+  freeSimulation(&sim);
+  freeTrace(&input);
+
+  if (worker->used + 256 > OUTPUT_CHUNK) {
+    flushOutput(worker);
+  }
+  worker->used += snprintf(worker->buffer + worker->used, OUTPUT_CHUNK - worker->used,
+                           "%s,%d,%d,%g,%d,%d,%.3f,%.3f,%.3f,%.3f,%ld,%ld\n",
+                           policyName(policy), floors, capacity, rate, seed_index, result.delivered,
+                           result.makespan / 1000.0,
+                           result.delivered ? result.totalWait / 1000.0 / result.delivered : 0.0,
+                           result.maxWait / 1000.0,
+                           result.delivered ? result.totalTrip / 1000.0 / result.delivered : 0.0,
+                           result.stops, result.floorsTraveled);
+}
+
+static void* workerThread(void* arg) {
+  sweepWorker* worker = arg;
+  long point;
+
+  while ((point = takePoint(worker)) >= 0) {
+    runPoint(worker, point);
+  }
+
+  flushOutput(worker);
+  return NULL;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-p policies] [-f floors] [-c capacities] [-r rates] [-s seeds] [-n passengers]\n"
+                  "          [-S base_seed] [-j threads] [-o output.csv]\n", name);
+  fprintf(stderr, "  policies: comma separated list of fcfs, sdf, round_robin or all (default all)\n");
+  fprintf(stderr, "  floors, capacities, rates: comma separated values or lo:hi:step ranges\n");
+  fprintf(stderr, "  rates are in passengers per minute (test_code.c sends 30)\n");
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  int opt, i;
+  long per_worker, steals = 0;
+  double elapsed;
+  struct timespec start, end;
+
+  floorValues[0] = NUM_FLOORS;
+  capacityValues[0] = ELEVATOR_CAPACITY;
+  rateValues[0] = 30;
+  parsePolicies("all");
+  numWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+  output = stdout;
+
+  while ((opt = getopt(argc, argv, "p:f:c:r:s:n:S:j:o:")) != -1) {
+    switch (opt) {
+      case 'p':
+        if (parsePolicies(optarg) <= 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'f':
+        numFloorValues = parseList(optarg, floorValues);
+        break;
+      case 'c':
+        numCapacityValues = parseList(optarg, capacityValues);
+        break;
+      case 'r':
+        numRateValues = parseList(optarg, rateValues);
+        break;
+      case 's':
+        numSeeds = atoi(optarg);
+        break;
+      case 'n':
+        numPassengers = atoi(optarg);
+        break;
+      case 'S':
+        baseSeed = strtoull(optarg, NULL, 0);
+        break;
+      case 'j':
+        numWorkers = atoi(optarg);
+        break;
+      case 'o':
+        if ((output = fopen(optarg, "w")) == NULL) {
+          perror(optarg);
+          return 1;
+        }
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || numFloorValues <= 0 || numCapacityValues <= 0 || numRateValues <= 0
+      || numSeeds < 1 || numPassengers < 1 || numWorkers < 1) {
+    usage(argv[0]);
+  }
+  for (i=0; i<numFloorValues; i++) {
+    if (floorValues[i] < 2) {
+      fprintf(stderr, "sweep: buildings need at least 2 floors\n");
+      return 1;
+    }
+  }
+  for (i=0; i<numCapacityValues; i++) {
+    if (capacityValues[i] < 1) {
+      fprintf(stderr, "sweep: capacity must be at least 1\n");
+      return 1;
+    }
+  }
+  for (i=0; i<numRateValues; i++) {
+    if (rateValues[i] <= 0) {
+      fprintf(stderr, "sweep: rates must be positive\n");
+      return 1;
+    }
+  }
+
+  totalPoints = (long)numPolicies * numFloorValues * numCapacityValues * numRateValues * numSeeds;
+  unclaimed = totalPoints;
+  if (numWorkers > totalPoints) {
+    numWorkers = totalPoints;
+  }
+
+  fprintf(output, "policy,floors,capacity,rate,seed,delivered,makespan_s,mean_wait_s,max_wait_s,mean_trip_s,stops,floors_traveled\n");
+
+  workers = aligned_alloc(64, sizeof(sweepWorker) * numWorkers);
+  per_worker = totalPoints / numWorkers;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (i=0; i<numWorkers; i++) {
+    pthread_mutex_init(&workers[i].range.lock, NULL);
+    workers[i].range.next = i * per_worker;
+    workers[i].range.end = i == numWorkers - 1 ? totalPoints : (i + 1) * per_worker;
+    workers[i].id = i;
+    workers[i].victim = 0;
+    workers[i].used = 0;
+    workers[i].steals = 0;
+    if ((workers[i].buffer = malloc(OUTPUT_CHUNK)) == NULL) {
+      fprintf(stderr, "sweep: out of memory\n");
+      return 1;
+    }
+  }
+  for (i=0; i<numWorkers; i++) {
+    pthread_create(&workers[i].thread, NULL, workerThread, &workers[i]);
+  }
+
+  for (i=0; i<numWorkers; i++) {
+    pthread_join(workers[i].thread, NULL);
+    steals += workers[i].steals;
+    free(workers[i].buffer);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%ld simulations on %d threads in %.2f s (%.0f per second, %ld steals)\n",
+          totalPoints, numWorkers, elapsed, totalPoints / elapsed, steals);
+
+  free(workers);
+  if (output != stdout) {
+    fclose(output);
+  }
+  return 0;
+}
@@ -0,0 +1,433 @@
+/* Zoned express service for tall buildings.
+ * Simulates a group of cars in one building two ways on the same generated passengers:
+ * - unzoned: every car serves every floor and requests are dealt to the cars in turn;
+ * - zoned: the floors above the lobby are split into one contiguous band per car, and each car only serves the
+ *   lobby and its band, so it runs nonstop (express) between the lobby and the band. A request goes to the car that
+ *   owns its floors; a trip between two bands is split into two legs that transfer at the lobby.
+ *
+ * Each car is an ordinary simulation (elevator_sim.c) running the chosen policy, with setFloorLevels placing its
+ * floors in the building. The cars only interact through transfers: the second leg of a trip arrives at the lobby
+ * when its first leg is dropped off there. Those times depend on the other cars' runs, so the cars are run again
+ * with the updated times until none change; the runs are then exactly those of the cars running side by side.
+ *
+ * For both ways it prints the mean round trip time of a car (leaving the lobby until it is back), the mean and
+ * maximum wait (lobby transfers included), the mean trip time from request until drop off at the final destination,
+ * and the makespan, averaged over the seeds.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elevator_sim.h"
+
+#define MAX_CARS 64
+#define MAX_ROUNDS 100 // runs of all cars to settle the transfer times
+
+typedef struct journey {
+  long arrival; // ms
+  int origin; // building floors
+  int destination;
+  int car[2]; // car of each leg, car[1] = -1 if there is no transfer
+  int leg[2]; // position of each leg in its car's trace, which is also its passenger id - 1
+  long transfer; // ms the second leg arrives at the lobby
+} journey;
+
+typedef struct carLeg {
+  tripRequest request; // in the car's floors
+  int journey;
+  int leg;
+} carLeg;
+
+typedef struct car {
+  simulation sim;
+  int lowest, highest; // building floors served besides the lobby
+  int numFloors; // lobby + lowest..highest
+  int* levels; // building floor of each of the car's floors
+  carLeg* legs;
+  int numLegs;
+  trace input;
+} car;
+
+typedef struct modeResult {
+  double roundTrip; // ms
+  double meanWait;
+  double maxWait;
+  double meanTrip;
+  double transfers;
+  double makespan;
+  double rounds;
+  int unsettled; // seeds whose transfer times didn't settle within MAX_ROUNDS
+} modeResult;
+
+static int numFloors = 60, numCars = 4, capacity = ELEVATOR_CAPACITY, policy = ROUND_ROBIN;
+static double rate = 30;
+static int numSeeds = 10, numPassengers = 300;
+static unsigned long long baseSeed = 1;
+
+// Car floor of building floor for a car
+static int carFloor(const car* c, int floor) {
+  return floor == 0 ? 0 : floor - c->lowest + 1;
+}
+
+// Car whose band floor is in
+static int zoneOf(const car* cars, int floor) {
+  int i;
+
+  for (i=0; i<numCars; i++) {
+    if (floor >= cars[i].lowest && floor <= cars[i].highest) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/* Give every car its floors: all of them, or the lobby and one band each.
+ * Returns 0, or -1 if out of memory.
+ */
+static int setUpCars(car* cars, int zoned) {
+  int i, j;
+
+  for (i=0; i<numCars; i++) {
+    if (zoned) {
+      cars[i].lowest = 1 + i * (numFloors - 1) / numCars;
+      cars[i].highest = (i + 1) * (numFloors - 1) / numCars;
+    }
+    else {
+      cars[i].lowest = 1;
+      cars[i].highest = numFloors - 1;
+    }
+    cars[i].numFloors = cars[i].highest - cars[i].lowest + 2;
+    if ((cars[i].levels = malloc(cars[i].numFloors * sizeof(int))) == NULL) {
+      return -1;
+    }
+    cars[i].levels[0] = 0;
+    for (j=1; j<cars[i].numFloors; j++) {
+      cars[i].levels[j] = cars[i].lowest + j - 1;
+    }
+  }
+
+  return 0;
+}
+
+// Send each trip to a car: in turn when unzoned, otherwise to the band it starts or ends in, with a lobby transfer
+// when it starts in one band and ends in another
+static void routeJourneys(const car* cars, journey* journeys, int count, int zoned) {
+  int i, from, to;
+  journey* j;
+
+  for (i=0; i<count; i++) {
+    j = &journeys[i];
+    j->car[1] = -1;
+    j->transfer = j->arrival;
+    if (!zoned) {
+      j->car[0] = i % numCars;
+      continue;
+    }
+
+    from = j->origin == 0 ? -1 : zoneOf(cars, j->origin);
+    to = j->destination == 0 ? -1 : zoneOf(cars, j->destination);
+    if (from < 0) {
+      j->car[0] = to;
+    }
+    else {
+      j->car[0] = from;
+      if (to >= 0 && to != from) {
+        j->car[1] = to;
+      }
+    }
+  }
+}
+
+static int compareLegs(const void* a, const void* b) {
+  const carLeg* x = a, *y = b;
+
+  if (x->request.time != y->request.time) {
+    return x->request.time < y->request.time ? -1 : 1;
+  }
+  if (x->journey != y->journey) {
+    return x->journey < y->journey ? -1 : 1;
+  }
+  return x->leg - y->leg;
+}
+
+// Add leg of journey to the car that carries it
+static void addLeg(car* cars, journey* j, int index, int leg) {
+  car* c = &cars[j->car[leg]];
+  carLeg* l = &c->legs[c->numLegs++];
+
+  l->journey = index;
+  l->leg = leg;
+  if (leg == 0) {
+    l->request.time = j->arrival;
+    l->request.origin = carFloor(c, j->origin);
+    l->request.destination = carFloor(c, j->car[1] >= 0 ? 0 : j->destination);
+  }
+  else {
+    l->request.time = j->transfer;
+    l->request.origin = 0;
+    l->request.destination = carFloor(c, j->destination);
+  }
+}
+
+/* Run every car once on its legs, with the current transfer times.
+ * Returns 0, or -1 if out of memory.
+ */
+static int runCars(car* cars, journey* journeys, int count) {
+  int i, k;
+  car* c;
+
+  for (i=0; i<numCars; i++) {
+    cars[i].numLegs = 0;
+  }
+  for (i=0; i<count; i++) {
+    addLeg(cars, &journeys[i], i, 0);
+    if (journeys[i].car[1] >= 0) {
+      addLeg(cars, &journeys[i], i, 1);
+    }
+  }
+
+  for (i=0; i<numCars; i++) {
+    c = &cars[i];
+    // Passenger ids follow the trace order, so leg k of the sorted trace is passenger k + 1
+    qsort(c->legs, c->numLegs, sizeof(carLeg), compareLegs);
+    for (k=0; k<c->numLegs; k++) {
+      c->input.requests[k] = c->legs[k].request;
+      journeys[c->legs[k].journey].leg[c->legs[k].leg] = k;
+    }
+    c->input.count = c->numLegs;
+
+    freeSimulation(&c->sim);
+    if (initializeSimulation(&c->sim, c->numFloors, capacity, policy) < 0 || setFloorLevels(&c->sim, c->levels) < 0) {
+      return -1;
+    }
+    setEventLog(&c->sim, 1);
+    if (runSimulation(&c->sim, &c->input) < 0 || c->sim.logEvents < 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Mean ms from a car leaving the lobby until it gets back there, over all cars; adds the number of trips to *trips
+static double roundTrips(const car* cars, long* trips) {
+  int i;
+  long e, left;
+  double total = 0;
+  const simEvent* event;
+
+  for (i=0; i<numCars; i++) {
+    left = -1;
+    for (e=0; e<cars[i].sim.numEvents; e++) {
+      event = &cars[i].sim.events[e];
+      if (event->type != EVENT_MOVE) {
+        continue;
+      }
+      if (event->floor == 0) {
+        left = event->time;
+      }
+      else if (event->value == 0 && left >= 0) {
+        total += event->time + event->duration - left;
+        (*trips)++;
+        left = -1;
+      }
+    }
+  }
+
+  return total;
+}
+
+/* Simulate the journeys one way (zoned or not) and add its numbers to result.
+ * Returns 0, or -1 if out of memory.
+ */
+static int runMode(journey* journeys, int count, int zoned, modeResult* result) {
+  car cars[MAX_CARS];
+  const passengerRecord* first, *second;
+  int i, round, changed, transfers = 0;
+  long trips = 0, wait, max_wait = 0, end = 0, start = count > 0 ? journeys[0].arrival : 0;
+  double total_wait = 0, total_trip = 0, round_trip;
+  journey* j;
+
+  memset(cars, 0, sizeof(cars));
+  if (setUpCars(cars, zoned) < 0) {
+    return -1;
+  }
+  routeJourneys(cars, journeys, count, zoned);
+  for (i=0; i<numCars; i++) {
+    cars[i].legs = malloc((2 * count + 1) * sizeof(carLeg));
+    cars[i].input.requests = malloc((2 * count + 1) * sizeof(tripRequest));
+    if (cars[i].legs == NULL || cars[i].input.requests == NULL) {
+      return -1;
+    }
+  }
+
+  // Second legs arrive when their first leg gets to the lobby, which depends on every car's run: rerun until settled
+  for (round=1; round<=MAX_ROUNDS; round++) {
+    if (runCars(cars, journeys, count) < 0) {
+      return -1;
+    }
+    changed = 0;
+    for (i=0; i<count; i++) {
+      j = &journeys[i];
+      if (j->car[1] >= 0 && cars[j->car[0]].sim.records[j->leg[0]].alight != j->transfer) {
+        j->transfer = cars[j->car[0]].sim.records[j->leg[0]].alight;
+        changed = 1;
+      }
+    }
+    if (!changed) {
+      break;
+    }
+  }
+  if (round > MAX_ROUNDS) {
+    round = MAX_ROUNDS;
+    result->unsettled++;
+  }
+
+  for (i=0; i<count; i++) {
+    j = &journeys[i];
+    first = &cars[j->car[0]].sim.records[j->leg[0]];
+    wait = first->board - j->arrival;
+    second = first;
+    if (j->car[1] >= 0) {
+      second = &cars[j->car[1]].sim.records[j->leg[1]];
+      wait += second->board - j->transfer;
+      transfers++;
+    }
+    total_wait += wait;
+    total_trip += second->alight - j->arrival;
+    if (wait > max_wait) {
+      max_wait = wait;
+    }
+  }
+  for (i=0; i<numCars; i++) {
+    if (cars[i].sim.drainTime > end) {
+      end = cars[i].sim.drainTime;
+    }
+  }
+  round_trip = roundTrips(cars, &trips);
+
+  result->roundTrip += trips ? round_trip / trips : 0;
+  result->meanWait += count ? total_wait / count : 0;
+  result->maxWait += max_wait;
+  result->meanTrip += count ? total_trip / count : 0;
+  result->transfers += transfers;
+  result->makespan += end - start;
+  result->rounds += round;
+
+  for (i=0; i<numCars; i++) {
+    freeSimulation(&cars[i].sim);
+    free(cars[i].levels);
+    free(cars[i].legs);
+    free(cars[i].input.requests);
+  }
+  return 0;
+}
+
+static void printMode(const char* name, const modeResult* result) {
+  printf("%-8s %14.2f %10.2f %12.2f %10.2f %10.1f %12.2f %8.1f\n", name, result->roundTrip / numSeeds / 1000,
+         result->meanWait / numSeeds / 1000, result->maxWait / numSeeds / 1000, result->meanTrip / numSeeds / 1000,
+         result->transfers / numSeeds, result->makespan / numSeeds / 1000, result->rounds / numSeeds);
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-f floors] [-k cars] [-c capacity] [-p policy] [-r rate] [-s seeds] [-n passengers]"
+                  " [-S base_seed]\n", name);
+  fprintf(stderr, "  rate in passengers per minute; policy: fcfs, sdf or round_robin (default round_robin)\n");
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  int opt, s, i;
+  trace input;
+  journey* journeys;
+  modeResult unzoned, zoned;
+  car bands[MAX_CARS];
+
+  while ((opt = getopt(argc, argv, "f:k:c:p:r:s:n:S:")) != -1) {
+    switch (opt) {
+      case 'f':
+        numFloors = atoi(optarg);
+        break;
+      case 'k':
+        numCars = atoi(optarg);
+        break;
+      case 'c':
+        capacity = atoi(optarg);
+        break;
+      case 'p':
+        if ((policy = policyFromName(optarg)) < 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'r':
+        rate = atof(optarg);
+        break;
+      case 's':
+        numSeeds = atoi(optarg);
+        break;
+      case 'n':
+        numPassengers = atoi(optarg);
+        break;
+      case 'S':
+        baseSeed = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || numCars < 1 || numCars > MAX_CARS || numFloors < numCars + 1 || capacity < 1 || rate <= 0
+      || numSeeds < 1 || numPassengers < 1) {
+    usage(argv[0]);
+  }
+
+  memset(&unzoned, 0, sizeof(unzoned));
+  memset(&zoned, 0, sizeof(zoned));
+  if ((journeys = malloc(numPassengers * sizeof(journey))) == NULL) {
+    fprintf(stderr, "zoning: out of memory\n");
+    return 1;
+  }
+
+  for (s=0; s<numSeeds; s++) {
+    if (generateTrace(&input, numFloors, rate, numPassengers, baseSeed + s) < 0) {
+      fprintf(stderr, "zoning: out of memory\n");
+      return 1;
+    }
+    for (i=0; i<numPassengers; i++) {
+      journeys[i].arrival = input.requests[i].time;
+      journeys[i].origin = input.requests[i].origin;
+      journeys[i].destination = input.requests[i].destination;
+    }
+    if (runMode(journeys, numPassengers, 0, &unzoned) < 0 || runMode(journeys, numPassengers, 1, &zoned) < 0) {
+      fprintf(stderr, "zoning: out of memory\n");
+      return 1;
+    }
+    freeTrace(&input);
+  }
+
+  printf("# %d floors, %d cars of capacity %d running %s, %.1f passengers per minute, %d seeds of %d passengers\n",
+         numFloors, numCars, capacity, policyName(policy), rate, numSeeds, numPassengers);
+  memset(bands, 0, sizeof(bands));
+  if (setUpCars(bands, 1) == 0) {
+    printf("# zones:");
+    for (i=0; i<numCars; i++) {
+      printf(" %d-%d", bands[i].lowest, bands[i].highest);
+    }
+    printf("\n");
+  }
+  for (i=0; i<numCars; i++) {
+    free(bands[i].levels);
+  }
+  printf("%-8s %14s %10s %12s %10s %10s %12s %8s\n", "mode", "round_trip_s", "wait_s", "max_wait_s", "trip_s",
+         "transfers", "makespan_s", "rounds");
+  printMode("unzoned", &unzoned);
+  printMode("zoned", &zoned);
+  if (unzoned.unsettled + zoned.unsettled > 0) {
+    fprintf(stderr, "zoning: transfer times didn't settle within %d rounds for %d runs\n", MAX_ROUNDS,
+            unzoned.unsettled + zoned.unsettled);
+  }
+
+  free(journeys);
+  return 0;
+}
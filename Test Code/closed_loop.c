@@ -0,0 +1,279 @@
+/* Closed loop load generator.
+ * Runs M simulated riders against a module. Each rider writes a request through its own descriptor, waits on read()
+ * for the module to report the passenger dropped off, thinks for a random time (exponential, mean -z ms) and then
+ * makes its next trip. Unlike test_code.c, which sends a request every 2 seconds whatever the elevator is doing, the
+ * load adapts to the elevator: a slow elevator gets fewer requests, as it would from real riders.
+ *
+ * For each rider population in the sweep it prints the trips per minute the elevator sustained and the mean and 95th
+ * percentile response time (write until drop off). By Little's law riders = throughput * (response + think), so
+ * throughput grows with the population until the elevator saturates and response times grow instead.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <math.h>
+#include <time.h>
+
+#define BUFFER_LENGTH 32
+#define NUM_FLOORS 6
+#define MAX_RIDERS 1024
+#define MAX_TRIPS 4096 // response times kept per rider for percentiles
+
+typedef struct rider {
+  pthread_t thread;
+  unsigned int seed;
+  long trips; // completed before the step ended
+  double totalResponse, totalThink; // seconds
+  double responses[MAX_TRIPS];
+  int error; // errno if the rider had to give up
+} rider;
+
+static const char* devicePath = "/dev/sdf";
+static int numFloors = NUM_FLOORS;
+static double thinkMean = 5.0; // seconds
+static struct timespec stepEnd;
+static volatile int stopping = 0;
+
+static double secondsBetween(const struct timespec* start, const struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Same passenger mix as test_code.c
+static void randomRequest(unsigned int* seed, int* start, int* dest) {
+  if ((rand_r(seed) % 2) == 0) {
+    *start = (rand_r(seed) % (numFloors - 1)) + 1;
+    do {
+      *dest = (rand_r(seed) % (numFloors - 1)) + 1;
+    } while (*start == *dest);
+  }
+  else if ((rand_r(seed) % 2) == 0) {
+    *start = 0;
+    *dest = (rand_r(seed) % (numFloors - 1)) + 1;
+  }
+  else {
+    *dest = 0;
+    *start = (rand_r(seed) % (numFloors - 1)) + 1;
+  }
+}
+
+// Sleep for seconds, in short naps so a rider notices the end of the step
+static void think(double seconds) {
+  struct timespec nap;
+  double step;
+
+  while (seconds > 0 && !stopping) {
+    step = seconds < 0.1 ? seconds : 0.1;
+    nap.tv_sec = 0;
+    nap.tv_nsec = (long)(step * 1e9);
+    nanosleep(&nap, NULL);
+    seconds -= step;
+  }
+}
+
+static void* riderThread(void* arg) {
+  rider* self = arg;
+  char data[BUFFER_LENGTH];
+  struct timespec called, delivered;
+  int fd, start, dest, length;
+  double pause;
+
+  fd = open(devicePath, O_RDWR);
+  if (fd < 0) {
+    self->error = errno;
+    return NULL;
+  }
+
+  // Riders start out thinking, so their first calls are spread out instead of arriving together
+  pause = -thinkMean * log(1.0 - rand_r(&self->seed) / (RAND_MAX + 1.0));
+  think(pause);
+
+  while (!stopping) {
+    randomRequest(&self->seed, &start, &dest);
+    length = sprintf(data, "%d,%d", start, dest);
+
+    clock_gettime(CLOCK_MONOTONIC, &called);
+    if (write(fd, data, length) < 0) {
+      self->error = errno;
+      break;
+    }
+    // Blocks until the module reports the passenger dropped off
+    if (read(fd, data, sizeof(data)) < 0) {
+      self->error = errno;
+      break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &delivered);
+
+    // Trips still riding when the step ends are finished but not counted
+    if (secondsBetween(&stepEnd, &delivered) > 0) {
+      break;
+    }
+    if (self->trips < MAX_TRIPS) {
+      self->responses[self->trips] = secondsBetween(&called, &delivered);
+    }
+    self->totalResponse += secondsBetween(&called, &delivered);
+    self->trips++;
+
+    pause = -thinkMean * log(1.0 - rand_r(&self->seed) / (RAND_MAX + 1.0));
+    self->totalThink += pause;
+    think(pause);
+  }
+
+  close(fd);
+  return NULL;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return x < y ? -1 : x > y;
+}
+
+/* Run riders for seconds and print one line of results.
+ * Returns -1 if a rider couldn't open, write to or read from the device.
+ */
+static int runStep(int riders, int seconds) {
+  rider* population = calloc(riders, sizeof(rider));
+  struct timespec start;
+  double* responses;
+  double totalResponse = 0, totalThink = 0, throughput, p95 = 0;
+  long trips = 0, kept = 0;
+  int i, error = 0;
+  long j;
+
+  stopping = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  stepEnd = start;
+  stepEnd.tv_sec += seconds;
+  for (i=0; i<riders; i++) {
+    population[i].seed = 42 + i;
+    pthread_create(&population[i].thread, NULL, riderThread, &population[i]);
+  }
+
+  sleep(seconds);
+  stopping = 1;
+  // Riders still in the elevator finish their trips, so the next step starts with an empty building
+  for (i=0; i<riders; i++) {
+    pthread_join(population[i].thread, NULL);
+  }
+
+  for (i=0; i<riders; i++) {
+    trips += population[i].trips;
+    kept += population[i].trips < MAX_TRIPS ? population[i].trips : MAX_TRIPS;
+    totalResponse += population[i].totalResponse;
+    totalThink += population[i].totalThink;
+    if (population[i].error != 0) {
+      error = population[i].error;
+    }
+  }
+  if (kept > 0) {
+    responses = malloc(kept * sizeof(double));
+    kept = 0;
+    for (i=0; i<riders; i++) {
+      for (j=0; j<population[i].trips && j<MAX_TRIPS; j++) {
+        responses[kept++] = population[i].responses[j];
+      }
+    }
+    qsort(responses, kept, sizeof(double), compareDoubles);
+    p95 = responses[(long)(0.95 * (kept - 1))];
+    free(responses);
+  }
+  free(population);
+
+  throughput = trips / (double)seconds;
+  printf("%7d %8ld %12.2f %12.2f %12.2f %12.2f %12.2f\n", riders, trips, throughput * 60,
+         trips ? totalResponse / trips : 0.0, p95, trips ? totalThink / trips : 0.0,
+         trips ? throughput * (totalResponse + totalThink) / trips : 0.0);
+  fflush(stdout);
+
+  if (error != 0) {
+    fprintf(stderr, "closed_loop: a rider gave up on %s: %s\n", devicePath, strerror(error));
+    return -1;
+  }
+  return 0;
+}
+
+static int parseList(const char* text, int* values, int max) {
+  int count = 0;
+  int lo, hi, step, value;
+  char* copy = strdup(text), *item, *save;
+
+  for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    if (sscanf(item, "%d:%d:%d", &lo, &hi, &step) == 3 && step > 0) {
+      for (value = lo; value <= hi && count < max; value += step) {
+        values[count++] = value;
+      }
+    }
+    else if (sscanf(item, "%d", &value) == 1 && count < max) {
+      values[count++] = value;
+    }
+    else {
+      count = -1;
+      break;
+    }
+  }
+
+  free(copy);
+  return count;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-d device] [-m riders] [-z think_ms] [-s seconds] [-f floors]\n", name);
+  fprintf(stderr, "  riders: comma separated values or lo:hi:step ranges (default 1,2,4,8,16,32)\n");
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  int opt, i;
+  int populations[MAX_RIDERS] = { 1, 2, 4, 8, 16, 32 }, numPopulations = 6;
+  int seconds = 300;
+
+  while ((opt = getopt(argc, argv, "d:m:z:s:f:")) != -1) {
+    switch (opt) {
+      case 'd':
+        devicePath = optarg;
+        break;
+      case 'm':
+        numPopulations = parseList(optarg, populations, MAX_RIDERS);
+        if (numPopulations <= 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 'z':
+        thinkMean = atof(optarg) / 1000;
+        break;
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'f':
+        numFloors = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || seconds < 1 || numFloors < 2 || thinkMean < 0) {
+    usage(argv[0]);
+  }
+  for (i=0; i<numPopulations; i++) {
+    if (populations[i] < 1 || populations[i] > MAX_RIDERS) {
+      fprintf(stderr, "closed_loop: rider populations must be between 1 and %d\n", MAX_RIDERS);
+      return 1;
+    }
+  }
+
+  // The last column checks Little's law: it should come out close to the number of riders
+  printf("# %s, %d s per population, mean think time %.1f s, times in seconds\n", devicePath, seconds, thinkMean);
+  printf("%7s %8s %12s %12s %12s %12s %12s\n", "riders", "trips", "trips/min", "response", "p95_response",
+         "think", "x*(r+z)");
+  for (i=0; i<numPopulations; i++) {
+    if (runStep(populations[i], seconds) < 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
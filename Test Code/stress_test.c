@@ -0,0 +1,336 @@
+/* Submission path stress test.
+ * Runs N writer threads, each pinned to its own CPU with its own descriptor on the device, that write requests as
+ * fast as they can for a fixed time, and times every write(). Prints the requests per second of all threads together
+ * and the p50, p99, p999 and maximum latency of a write, for each thread count in the sweep, so it shows where
+ * dev_write stops scaling as more writers contend for it.
+ *
+ * Load the module with max_queue_depth=0 first, otherwise writes past the limit wait for the elevator to drop
+ * passengers off and the latencies are mostly that wait (or, with -n, EAGAIN failures).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BUFFER_LENGTH 32
+#define NUM_FLOORS 6
+#define MAX_THREADS 256
+
+// Latency histogram: SUB_BUCKETS linear buckets per power of two of ns, so percentiles are within 1/SUB_BUCKETS
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define MAX_POWER 40 // ~18 minutes, anything longer goes in the last bucket
+#define NUM_BUCKETS ((MAX_POWER - SUB_BITS + 2) * SUB_BUCKETS)
+
+typedef struct writerStats {
+  long requests;
+  long wouldBlock; // EAGAIN, only with -n
+  long failures;
+  int error; // errno of the last failure
+  long maxNs;
+  long histogram[NUM_BUCKETS];
+} writerStats;
+
+typedef struct writer {
+  pthread_t thread;
+  int cpu;
+  unsigned int seed;
+  writerStats stats;
+} writer;
+
+static const char* devicePath = "/dev/sdf";
+static int numFloors = NUM_FLOORS;
+static int nonBlocking = 0;
+static pthread_barrier_t startBarrier;
+static volatile int stopping = 0;
+
+static long elapsedNs(const struct timespec* start, const struct timespec* end) {
+  return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+static int bucketOf(long ns) {
+  int power = 0;
+
+  if (ns < SUB_BUCKETS) {
+    return ns < 0 ? 0 : (int)ns;
+  }
+  while ((ns >> power) >= 2 * SUB_BUCKETS) {
+    power++;
+  }
+  if (power > MAX_POWER - SUB_BITS) {
+    return NUM_BUCKETS - 1;
+  }
+  return power * SUB_BUCKETS + (int)(ns >> power);
+}
+
+// Upper bound in ns of the latencies counted in bucket
+static long bucketLimit(int bucket) {
+  int power = bucket / SUB_BUCKETS - 1;
+
+  if (power < 0) {
+    return bucket;
+  }
+  return ((long)(bucket % SUB_BUCKETS + SUB_BUCKETS + 1) << power) - 1;
+}
+
+// Latency at or below which fraction of the writes finished
+static long percentile(const writerStats* stats, double fraction) {
+  long total = 0, target, seen = 0;
+  int i;
+
+  for (i=0; i<NUM_BUCKETS; i++) {
+    total += stats->histogram[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  target = (long)(fraction * total + 0.5);
+  if (target < 1) {
+    target = 1;
+  }
+  for (i=0; i<NUM_BUCKETS; i++) {
+    seen += stats->histogram[i];
+    if (seen >= target) {
+      return bucketLimit(i) < stats->maxNs ? bucketLimit(i) : stats->maxNs;
+    }
+  }
+  return stats->maxNs;
+}
+
+// Same passenger mix as test_code.c
+static void randomRequest(unsigned int* seed, int* start, int* dest) {
+  if ((rand_r(seed) % 2) == 0) {
+    *start = (rand_r(seed) % (numFloors - 1)) + 1;
+    do {
+      *dest = (rand_r(seed) % (numFloors - 1)) + 1;
+    } while (*start == *dest);
+  }
+  else if ((rand_r(seed) % 2) == 0) {
+    *start = 0;
+    *dest = (rand_r(seed) % (numFloors - 1)) + 1;
+  }
+  else {
+    *dest = 0;
+    *start = (rand_r(seed) % (numFloors - 1)) + 1;
+  }
+}
+
+static void* writerThread(void* arg) {
+  writer* self = arg;
+  writerStats* stats = &self->stats;
+  char data[BUFFER_LENGTH];
+  struct timespec before, after;
+  cpu_set_t cpus;
+  int fd, start, dest, length;
+  long ns;
+
+  CPU_ZERO(&cpus);
+  CPU_SET(self->cpu, &cpus);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+    fprintf(stderr, "stress_test: could not pin a writer to CPU %d\n", self->cpu);
+  }
+
+  fd = open(devicePath, O_WRONLY | (nonBlocking ? O_NONBLOCK : 0));
+  pthread_barrier_wait(&startBarrier);
+  if (fd < 0) {
+    stats->failures++;
+    stats->error = errno;
+    return NULL;
+  }
+
+  while (!stopping) {
+    randomRequest(&self->seed, &start, &dest);
+    length = sprintf(data, "%d,%d", start, dest);
+
+    clock_gettime(CLOCK_MONOTONIC, &before);
+    if (write(fd, data, length) < 0) {
+      if (errno == EAGAIN) {
+        stats->wouldBlock++;
+      }
+      else if (errno != EINTR) {
+        stats->failures++;
+        stats->error = errno;
+        break;
+      }
+      continue;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &after);
+
+    ns = elapsedNs(&before, &after);
+    stats->histogram[bucketOf(ns)]++;
+    if (ns > stats->maxNs) {
+      stats->maxNs = ns;
+    }
+    stats->requests++;
+  }
+
+  close(fd);
+  return NULL;
+}
+
+/* Run threads writers for seconds and print one line of results.
+ * Returns -1 if a writer couldn't open or write to the device.
+ */
+static int runStep(int threads, const int* cpus, int numCpus, int seconds) {
+  writer* writers = calloc(threads, sizeof(writer));
+  writerStats total;
+  int error = 0;
+  struct timespec start, end;
+  double elapsed;
+  int i, j;
+
+  memset(&total, 0, sizeof(total));
+  stopping = 0;
+  pthread_barrier_init(&startBarrier, NULL, threads + 1);
+  for (i=0; i<threads; i++) {
+    writers[i].cpu = cpus[i % numCpus];
+    writers[i].seed = 42 + i;
+    pthread_create(&writers[i].thread, NULL, writerThread, &writers[i]);
+  }
+
+  pthread_barrier_wait(&startBarrier);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  sleep(seconds);
+  stopping = 1;
+  for (i=0; i<threads; i++) {
+    pthread_join(writers[i].thread, NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  pthread_barrier_destroy(&startBarrier);
+
+  for (i=0; i<threads; i++) {
+    total.requests += writers[i].stats.requests;
+    total.wouldBlock += writers[i].stats.wouldBlock;
+    total.failures += writers[i].stats.failures;
+    if (writers[i].stats.failures > 0) {
+      error = writers[i].stats.error;
+    }
+    if (writers[i].stats.maxNs > total.maxNs) {
+      total.maxNs = writers[i].stats.maxNs;
+    }
+    for (j=0; j<NUM_BUCKETS; j++) {
+      total.histogram[j] += writers[i].stats.histogram[j];
+    }
+  }
+  free(writers);
+
+  elapsed = elapsedNs(&start, &end) / 1e9;
+  printf("%7d %12ld %12.0f %10ld %10ld %10ld %12ld %10ld\n", threads, total.requests, total.requests / elapsed,
+         percentile(&total, 0.5), percentile(&total, 0.99), percentile(&total, 0.999), total.maxNs, total.wouldBlock);
+  fflush(stdout);
+
+  if (total.failures > 0) {
+    fprintf(stderr, "stress_test: %ld writers could not open or write to %s: %s\n", total.failures, devicePath,
+            strerror(error));
+    return -1;
+  }
+  return 0;
+}
+
+static int parseList(const char* text, int* values, int max) {
+  int count = 0;
+  int lo, hi, step, value;
+  char* copy = strdup(text), *item, *save;
+
+  for (item = strtok_r(copy, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save)) {
+    if (sscanf(item, "%d:%d:%d", &lo, &hi, &step) == 3 && step > 0) {
+      for (value = lo; value <= hi && count < max; value += step) {
+        values[count++] = value;
+      }
+    }
+    else if (sscanf(item, "%d", &value) == 1 && count < max) {
+      values[count++] = value;
+    }
+    else {
+      count = -1;
+      break;
+    }
+  }
+
+  free(copy);
+  return count;
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "usage: %s [-d device] [-t threads] [-s seconds] [-f floors] [-n]\n", name);
+  fprintf(stderr, "  threads: comma separated values or lo:hi:step ranges (default 1, 2, 4, ... up to the CPUs)\n");
+  fprintf(stderr, "  -n opens the device with O_NONBLOCK and counts EAGAIN instead of waiting for room\n");
+  exit(1);
+}
+
+int main(int argc, char* argv[]) {
+  int opt, i;
+  int threadCounts[MAX_THREADS], numThreadCounts = 0;
+  int cpus[CPU_SETSIZE], numCpus = 0;
+  int seconds = 5;
+  cpu_set_t allowed;
+
+  while ((opt = getopt(argc, argv, "d:t:s:f:n")) != -1) {
+    switch (opt) {
+      case 'd':
+        devicePath = optarg;
+        break;
+      case 't':
+        numThreadCounts = parseList(optarg, threadCounts, MAX_THREADS);
+        if (numThreadCounts <= 0) {
+          usage(argv[0]);
+        }
+        break;
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'f':
+        numFloors = atoi(optarg);
+        break;
+      case 'n':
+        nonBlocking = 1;
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  if (optind != argc || seconds < 1 || numFloors < 2) {
+    usage(argv[0]);
+  }
+
+  // Writers are pinned round robin to the CPUs this process may run on
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    perror("sched_getaffinity");
+    return errno;
+  }
+  for (i=0; i<CPU_SETSIZE; i++) {
+    if (CPU_ISSET(i, &allowed)) {
+      cpus[numCpus++] = i;
+    }
+  }
+  if (numThreadCounts == 0) {
+    for (i=1; i<numCpus; i*=2) {
+      threadCounts[numThreadCounts++] = i;
+    }
+    threadCounts[numThreadCounts++] = numCpus;
+  }
+  for (i=0; i<numThreadCounts; i++) {
+    if (threadCounts[i] < 1 || threadCounts[i] > MAX_THREADS) {
+      fprintf(stderr, "stress_test: thread counts must be between 1 and %d\n", MAX_THREADS);
+      return 1;
+    }
+  }
+
+  printf("# %s, %d s per step, %d CPUs, %s writes, latencies in ns\n", devicePath, seconds, numCpus,
+         nonBlocking ? "non blocking" : "blocking");
+  printf("%7s %12s %12s %10s %10s %10s %12s %10s\n", "threads", "requests", "requests/s", "p50", "p99", "p999", "max",
+         "eagain");
+  for (i=0; i<numThreadCounts; i++) {
+    if (runStep(threadCounts[i], cpus, numCpus, seconds) < 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
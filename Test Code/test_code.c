@@ -15,10 +15,22 @@
 static char data[BUFFER_LENGTH];
 
 int main(int argc, char* argv[]) {
-  int ret, fd, i, n;
+  int ret, fd, i;
+  FILE* trace_file = NULL;
+  struct timespec first_write = { 0, 0 }, now;
 
   printf("test started\n");
 
+  // Optionally record every request as "<ms since the first request> <origin> <destination>" for the simulator
+  if (argc > 1) {
+    trace_file = fopen(argv[1], "w");
+    if (trace_file == NULL) {
+      perror("trace open failed");
+      return errno;
+    }
+    fprintf(trace_file, "# time_ms origin destination\n");
+  }
+
   fd = open("/dev/sdf", O_RDWR);
 
   if (fd < 0) {
@@ -59,14 +71,26 @@ int main(int argc, char* argv[]) {
 
     sprintf(data, "%d,%d", start, dest);
     printf("Data: %s, id: %d\n", data, i+1);
-    ret = write(fd, data, BUFFER_LENGTH);
+    ret = write(fd, data, strlen(data));
     if (ret < 0) {
       perror("write failed");
       return errno;
     }
+    if (trace_file != NULL) {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      if (i == 0) {
+        first_write = now;
+      }
+      fprintf(trace_file, "%ld %d %d\n", (now.tv_sec - first_write.tv_sec) * 1000 + (now.tv_nsec - first_write.tv_nsec) / 1000000, start, dest);
+      fflush(trace_file);
+    }
     sleep(2);
   }
 
+  if (trace_file != NULL) {
+    fclose(trace_file);
+  }
+
 /*
 write(fd, "0,4", BUFFER_LENGTH);
 sleep(2);